@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "bitmap.hpp"
+
+#define PROCESS_COUNT	4
+#define THREAD_COUNT	4
+#define BIT_COUNT		1000000
+
+typedef AtomicBitmap<uint64_t> SeenBitmap;
+
+// every worker marks the same ids, a crawler seeing the same urls
+void* Worker(void* arg)
+{
+	SeenBitmap* pSeen = (SeenBitmap*)arg;
+	for(uint64_t id=0; id<BIT_COUNT; id+=3)
+		pSeen->Set(id);
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	unlink("./atomicbitmap.data");
+	MapStorage fs;
+	if(MapStorage::OpenStorage(&fs, "./atomicbitmap.data", SeenBitmap::GetBufferSize(BIT_COUNT)) < 0)
+	{
+		printf("error: open storage fail.\n");
+		return -1;
+	}
+	SeenBitmap seen = SeenBitmap::LoadBitmap(fs);
+	if(!seen.Success())
+	{
+		printf("error: load bitmap fail.\n");
+		return -1;
+	}
+
+	for(int i=0; i<PROCESS_COUNT; ++i)
+	{
+		if(fork() != 0)
+			continue;
+
+		MapStorage childStorage;
+		MapStorage::OpenStorage(&childStorage, "./atomicbitmap.data", SeenBitmap::GetBufferSize(BIT_COUNT));
+		SeenBitmap child = SeenBitmap::LoadBitmap(childStorage);
+
+		pthread_t threads[THREAD_COUNT];
+		for(int t=0; t<THREAD_COUNT; ++t)
+			pthread_create(&threads[t], NULL, Worker, &child);
+		for(int t=0; t<THREAD_COUNT; ++t)
+			pthread_join(threads[t], NULL);
+
+		childStorage.Release();
+		exit(0);
+	}
+	for(int i=0; i<PROCESS_COUNT; ++i)
+		wait(NULL);
+
+	printf("bits: %lu, used: %lu (expect %u)\n", seen.GetBitCount(), seen.GetUsed(), (BIT_COUNT + 2) / 3);
+	printf("popcount: %lu, capacity: %.02f%%\n", seen.PopCount(), seen.Capacity() * 100);
+
+	fs.Release();
+	unlink("./atomicbitmap.data");
+	return 0;
+}
+
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "bitmap.hpp"
+
+#define BENCHMARK_BITS		(1ULL << 28)
+#define BENCHMARK_ROUND		10
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000000000.0 + (end.tv_usec - begin.tv_usec) * 1000.0;
+}
+
+void Fill(Bitmap<uint64_t>& bitmap, uint64_t count)
+{
+	for(uint64_t i=0; i<count; ++i)
+		bitmap.Set(((uint64_t)rand() << 16 ^ rand()) % BENCHMARK_BITS);
+}
+
+struct SetBitCounter
+{
+	uint64_t*	pCount;
+
+	void operator()(uint64_t pos)
+	{
+		++*pCount;
+	}
+};
+
+// GB of both operands read per second
+double Throughput(double ns)
+{
+	return BENCHMARK_BITS / 8 * 2 * BENCHMARK_ROUND / ns;
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t threads = (argc > 1)?atoi(argv[1]):1;
+
+	Bitmap<uint64_t> bitmap1 = Bitmap<uint64_t>::CreateBitmap(BENCHMARK_BITS);
+	Bitmap<uint64_t> bitmap2 = Bitmap<uint64_t>::CreateBitmap(BENCHMARK_BITS);
+	Bitmap<uint64_t> result = Bitmap<uint64_t>::CreateBitmap(BENCHMARK_BITS);
+	if(!bitmap1.Success() || !bitmap2.Success() || !result.Success())
+	{
+		printf("error: create bitmap fail.\n");
+		return -1;
+	}
+
+	srand(time(NULL));
+	Fill(bitmap1, BENCHMARK_BITS / 4);
+	Fill(bitmap2, BENCHMARK_BITS / 4);
+	printf("bits: %llu, threads: %u\n", (unsigned long long)BENCHMARK_BITS, threads);
+
+	// the same And one bit at a time, the way it is done without the bulk operations
+	timeval begin;
+	gettimeofday(&begin, NULL);
+	uint64_t used = 0;
+	for(uint64_t i=0; i<BENCHMARK_BITS; ++i)
+	{
+		if(bitmap1.Contains(i) && bitmap2.Contains(i))
+		{
+			result.Set(i);
+			++used;
+		}
+	}
+	double ns = Elapsed(begin);
+	printf("Contains/Set per bit : %.02f GB/s, used: %llu\n", BENCHMARK_BITS / 8 * 2 / ns, (unsigned long long)used);
+
+	gettimeofday(&begin, NULL);
+	for(uint32_t i=0; i<BENCHMARK_ROUND; ++i)
+	{
+		result.Or(bitmap1, threads);
+		result.And(bitmap2, threads);
+	}
+	printf("Or + And             : %.02f GB/s, used: %llu\n", Throughput(Elapsed(begin) / 2), (unsigned long long)result.PopCount());
+
+	gettimeofday(&begin, NULL);
+	for(uint32_t i=0; i<BENCHMARK_ROUND; ++i)
+		result.Xor(bitmap1, threads);
+	printf("Xor                  : %.02f GB/s, used: %llu\n", Throughput(Elapsed(begin)), (unsigned long long)result.PopCount());
+
+	gettimeofday(&begin, NULL);
+	for(uint32_t i=0; i<BENCHMARK_ROUND; ++i)
+		result.AndNot(bitmap2, threads);
+	printf("AndNot               : %.02f GB/s, used: %llu\n", Throughput(Elapsed(begin)), (unsigned long long)result.PopCount());
+
+	gettimeofday(&begin, NULL);
+	for(uint32_t i=0; i<BENCHMARK_ROUND; ++i)
+		used = bitmap1.PopCount(threads);
+	printf("PopCount             : %.02f GB/s, used: %llu\n", Throughput(Elapsed(begin)) / 2, (unsigned long long)used);
+
+	printf("IsSubset             : %s\n", result.IsSubset(bitmap1)?"true":"false");
+
+	// members of bitmap1 by probing every bit, and with ctz over words
+	gettimeofday(&begin, NULL);
+	used = 0;
+	for(uint64_t i=0; i<BENCHMARK_BITS; ++i)
+	{
+		if(bitmap1.Contains(i))
+			++used;
+	}
+	printf("Contains scan        : %.02f ns/bit, members: %llu\n", Elapsed(begin) / BENCHMARK_BITS, (unsigned long long)used);
+
+	gettimeofday(&begin, NULL);
+	used = 0;
+	SetBitCounter counter = { &used };
+	bitmap1.ForEach(counter);
+	printf("ForEach              : %.02f ns/bit, members: %llu\n", Elapsed(begin) / BENCHMARK_BITS, (unsigned long long)used);
+
+	gettimeofday(&begin, NULL);
+	used = 0;
+	for(uint64_t pos=bitmap1.NextSetBit(0); pos!=BITMAP_NPOS; pos=bitmap1.NextSetBit(pos + 1))
+		++used;
+	printf("NextSetBit           : %.02f ns/bit, members: %llu\n", Elapsed(begin) / BENCHMARK_BITS, (unsigned long long)used);
+
+	std::vector<char> vRank(Bitmap<uint64_t>::GetRankSize(BENCHMARK_BITS));
+	gettimeofday(&begin, NULL);
+	bitmap1.AttachRank(&vRank[0], vRank.size());
+	printf("AttachRank           : %.02f ms, %lu bytes\n", Elapsed(begin) / 1000000, vRank.size());
+
+	std::vector<uint64_t> vPos(BENCHMARK_BITS / 256);
+	for(size_t i=0; i<vPos.size(); ++i)
+		vPos[i] = ((uint64_t)rand() << 16 ^ rand()) % BENCHMARK_BITS;
+
+	gettimeofday(&begin, NULL);
+	uint64_t sum = 0;
+	for(size_t i=0; i<vPos.size(); ++i)
+		sum += bitmap1.Rank(vPos[i]);
+	printf("Rank                 : %.02f ns/op, checksum: %llu\n", Elapsed(begin) / vPos.size(), (unsigned long long)sum);
+
+	gettimeofday(&begin, NULL);
+	sum = 0;
+	for(size_t i=0; i<vPos.size(); ++i)
+		sum += bitmap1.Select(vPos[i] % used);
+	printf("Select               : %.02f ns/op, checksum: %llu\n", Elapsed(begin) / vPos.size(), (unsigned long long)sum);
+
+	bitmap1.Delete();
+	bitmap2.Delete();
+	result.Delete();
+	return 0;
+}
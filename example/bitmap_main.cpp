@@ -51,8 +51,23 @@ int main(int argc, char* argv[])
 
 	// dump bitmap buffer
 	bm.Dump();
-
 	bm.Delete();
+
+	// ids of a bitmap with its rank directory right after it in one buffer,
+	// read a page at a time
+	size_t bitmapSize = Bitmap<uint64_t>::GetBufferSize(100000);
+	std::vector<char> vBuffer(bitmapSize + Bitmap<uint64_t>::GetRankSize(100000));
+	Bitmap<uint64_t> ids = Bitmap<uint64_t>::LoadBitmap(&vBuffer[0], bitmapSize);
+	for(uint64_t id=0; id<100000; id+=7)
+		ids.Set(id);
+	ids.AttachRank(&vBuffer[bitmapSize], vBuffer.size() - bitmapSize);
+
+	uint64_t page = 3;
+	printf("ids below 50000: %lu, page %lu:", ids.Rank(50000), page);
+	uint64_t id = ids.Select(page * 10);
+	for(int n=0; n<10 && id!=BITMAP_NPOS; ++n, id=ids.NextSetBit(id + 1))
+		printf(" %lu", id);
+	printf("\n");
 	return 0;
 }
 
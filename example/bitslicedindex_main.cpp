@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "bitmap.hpp"
+#include "bitslicedindex.hpp"
+
+#define DOCUMENT_COUNT	4000000
+#define PRICE_BITS		20
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000.0 + (end.tv_usec - begin.tv_usec) / 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	BitSlicedIndex<> price = BitSlicedIndex<>::CreateIndex(DOCUMENT_COUNT, PRICE_BITS);
+	Bitmap<uint64_t> category = Bitmap<uint64_t>::CreateBitmap(price.GetCount());
+	Bitmap<uint64_t> result = Bitmap<uint64_t>::CreateBitmap(price.GetCount());
+	if(!price.Success() || !category.Success() || !result.Success())
+	{
+		printf("error: create index fail.\n");
+		return -1;
+	}
+
+	// every document has a price in cents, one in 8 is in the category
+	srandom(time(NULL));
+	std::vector<uint32_t> vPrice(DOCUMENT_COUNT);
+	for(uint64_t id=0; id<DOCUMENT_COUNT; ++id)
+	{
+		vPrice[id] = random() % (1 << PRICE_BITS);
+		price.Set(id, vPrice[id]);
+		if(random() % 8 == 0)
+			category.Set(id);
+	}
+
+	// price BETWEEN 10000 AND 50000 AND category
+	timeval begin;
+	gettimeofday(&begin, NULL);
+	price.Between(10000, 50000, result);
+	result.And(category);
+	double elapsed = Elapsed(begin);
+	printf("bit sliced: %lu documents, %.02f ms\n", result.PopCount(), elapsed);
+
+	gettimeofday(&begin, NULL);
+	uint64_t count = 0;
+	for(uint64_t id=0; id<DOCUMENT_COUNT; ++id)
+	{
+		if(vPrice[id] >= 10000 && vPrice[id] <= 50000 && category.Contains(id))
+			++count;
+	}
+	printf("scan      : %lu documents, %.02f ms\n", count, Elapsed(begin));
+
+	price.LessThan(100, result);
+	printf("price < 100: %lu documents\n", result.PopCount());
+	price.GreaterThan(1000000, result);
+	printf("price > 1000000: %lu documents\n", result.PopCount());
+
+	price.Delete();
+	category.Delete();
+	result.Delete();
+	return 0;
+}
+
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "blobhashtable.hpp"
+
+int main(int argc, char* argv[])
+{
+	Seed seed(1000, 10);
+	MapStorage fs;
+	if(MapStorage::OpenStorage(&fs, "./blob.data", BlobHashTable<uint64_t>::GetBufferSize(seed, 4 * 1024 * 1024)) < 0)
+	{
+		printf("error: open data file fail.\n");
+		return -1;
+	}
+
+	BlobHashTable<uint64_t> bht = BlobHashTable<uint64_t>::LoadHashTable(fs, seed);
+	if(!bht.Success())
+	{
+		printf("error: load blob hashtable fail.\n");
+		return -1;
+	}
+
+	uint64_t i=1;
+	for(; i<=5000; ++i)
+	{
+		char buffer[64];
+		int len = snprintf(buffer, sizeof(buffer), "user%lu", i);
+		if(!bht.Put(i, buffer, len))
+			break;
+
+		// grow some values past their size class
+		for(uint64_t j=0; j<i%20; ++j)
+			if(!bht.Append(i, ",tag", 4))
+				break;
+	}
+	printf("insert count: %lu\n", i - 1);
+
+	uint32_t len = 0;
+	char* pValue = bht.Get(19, &len);
+	if(pValue)
+		printf("19: %.*s\n", len, pValue);
+
+	bht.Clear(19);
+	printf("19 after clear: %s\n", bht.Get(19)?"found":"not found");
+
+	printf("capacity: %.02f%%, blob capacity: %.02f%%\n", bht.Capacity() * 100, bht.BlobCapacity() * 100);
+
+	// reload from the same storage
+	bht = BlobHashTable<uint64_t>::LoadHashTable(fs, seed);
+	pValue = bht.Get(18, &len);
+	if(pValue)
+		printf("18 after reload: %.*s\n", len, pValue);
+
+	seed.Release();
+	fs.Release();
+	unlink("./blob.data");
+	return 0;
+}
+
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "bitmap.hpp"
+#include "bloomfilter.hpp"
+
+#define BENCHMARK_COUNT		4000000
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000000000.0 + (end.tv_usec - begin.tv_usec) * 1000.0;
+}
+
+// add, hit and miss ns/op and the false positive rate of a filter holding vKeys
+template<typename FilterT>
+void Run(const char* name, FilterT& bf, std::vector<uint64_t>& vKeys, std::vector<uint64_t>& vMiss)
+{
+	timeval begin;
+	gettimeofday(&begin, NULL);
+	for(size_t i=0; i<vKeys.size(); ++i)
+		bf.Add(vKeys[i]);
+	double add = Elapsed(begin) / vKeys.size();
+
+	size_t found = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t i=0; i<vKeys.size(); ++i)
+		found += bf.Contains(vKeys[i]);
+	double hit = Elapsed(begin) / vKeys.size();
+
+	size_t positive = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t i=0; i<vMiss.size(); ++i)
+		positive += bf.Contains(vMiss[i]);
+	double miss = Elapsed(begin) / vMiss.size();
+
+	printf("%-18s add: %6.02f ns, hit: %6.02f ns, miss: %6.02f ns, found: %lu, false positive: %.04f%%, capacity: %.02f%%\n",
+			name, add, hit, miss, found, (double)positive * 100 / vMiss.size(), bf.Capacity() * 100);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t count = (argc > 1)?strtoul(argv[1], NULL, 10):BENCHMARK_COUNT;
+
+	// odd keys are added, even keys never are
+	srand(time(NULL));
+	std::vector<uint64_t> vKeys(count);
+	std::vector<uint64_t> vMiss(count);
+	for(size_t i=0; i<count; ++i)
+	{
+		vKeys[i] = ((uint64_t)rand() << 32 ^ rand()) | 1;
+		vMiss[i] = ((uint64_t)rand() << 32 ^ rand()) & ~1ULL;
+	}
+
+	double errors[] = { 0.01, 0.001, 0.0001 };
+	for(size_t i=0; i<sizeof(errors)/sizeof(double); ++i)
+	{
+		size_t size = BloomFilter<uint64_t>::GetBufferSize(count, errors[i]);
+		size_t k = BloomFilter<uint64_t>::GetK(count, errors[i]);
+		printf("error: %.02f%%, size: %lu, k: %lu\n", errors[i] * 100, size, k);
+
+		BloomFilter<uint64_t> bf = BloomFilter<uint64_t>::CreateBloomFilter(size, k);
+		Run("BloomFilter", bf, vKeys, vMiss);
+		bf.Delete();
+
+		BlockedBloomFilter<uint64_t> bbf = BlockedBloomFilter<uint64_t>::CreateBloomFilter(size, k);
+		Run("BlockedBloomFilter", bbf, vKeys, vMiss);
+		bbf.Delete();
+	}
+	return 0;
+}
+
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "buckethashtable.hpp"
+
+struct Value
+{
+	uint32_t	dwData;
+} __attribute__((packed));
+
+// switching back is a matter of this typedef
+typedef BucketHashTable<uint64_t, Value> IndexTable;
+
+#define CHURN_PHASES		50
+#define CHURN_WARMUP		10
+#define CHURN_MISSES		1000000
+
+// ns per lookup of keys never inserted
+double MissCost(IndexTable& ht, uint64_t firstMiss)
+{
+	timeval begin, end;
+	size_t found = 0;
+	gettimeofday(&begin, NULL);
+	for(uint64_t i=0; i<CHURN_MISSES; ++i)
+	{
+		if(ht.Hash(firstMiss + i))
+			++found;
+	}
+	gettimeofday(&end, NULL);
+	if(found)
+		printf("error: %lu misses found\n", found);
+	return ((end.tv_sec - begin.tv_sec) * 1000000000.0 + (end.tv_usec - begin.tv_usec) * 1000.0) / CHURN_MISSES;
+}
+
+int main(int argc, char* argv[])
+{
+	Seed seed(100000, 10);
+	size_t size = IndexTable::GetBufferSize(seed);
+
+	char* buffer = (char*)malloc(size);
+	memset(buffer, 0, size);
+	IndexTable ht = IndexTable::LoadHashTable(buffer, size, seed);
+	if(!ht.Success())
+	{
+		printf("error: load hashtable fail.\n");
+		return -1;
+	}
+
+	// buckets take keys far past the load a row per probe allows
+	uint64_t key = 1;
+	for(; ht.Capacity() < 0.95; ++key)
+	{
+		Value* pValue = ht.Hash(key, true);
+		if(pValue == NULL)
+			break;
+		pValue->dwData = key;
+	}
+
+	// clear every other key, the others must still be found
+	for(uint64_t i=1; i<key; i+=2)
+		ht.Clear(i);
+
+	size_t wrong = 0;
+	for(uint64_t i=1; i<key; ++i)
+	{
+		Value* pValue = ht.Hash(i);
+		if((i % 2 == 1 && pValue != NULL) || (i % 2 == 0 && (pValue == NULL || pValue->dwData != i)))
+			++wrong;
+	}
+
+	size_t count = 0;
+	HashTableIterator iter;
+	while(ht.Next(&iter))
+		++count;
+	printf("keys: %lu, left: %lu, capacity: %.02f%%, wrong: %lu\n", key - 1, count, ht.Capacity() * 100, wrong);
+
+	// the same buffer loads again with the same seed
+	IndexTable reload = IndexTable::LoadHashTable(buffer, size, seed);
+	printf("reload: %s, key 2: %u\n", reload.Success()?"ok":"fail", reload.Hash(2)?reload.Hash(2)->dwData:0);
+
+	seed.Release();
+	free(buffer);
+
+	// churn at 85% load: each phase clears the oldest tenth of the keys
+	// and inserts as many new ones. Misses cost more once the keys have
+	// spread past their buckets than right after the fill, but must not
+	// keep getting slower after that.
+	Seed churnSeed(65536, 16);
+	IndexTable churn = IndexTable::CreateHashTable(churnSeed);
+	uint64_t oldest = 1, next = 1;
+	for(; churn.Capacity() < 0.85; ++next)
+		churn.Hash(next, true)->dwData = next;
+
+	uint64_t tenth = (next - oldest) / 10;
+	double fresh = MissCost(churn, 1ULL << 40), before = 0;
+	for(int phase=0; phase<CHURN_PHASES; ++phase)
+	{
+		if(phase == CHURN_WARMUP)
+			before = MissCost(churn, 1ULL << 40);
+
+		for(uint64_t i=0; i<tenth; ++i)
+			churn.Clear(oldest++);
+		for(uint64_t i=0; i<tenth; ++i, ++next)
+			churn.Hash(next, true)->dwData = next;
+	}
+	double after = MissCost(churn, 1ULL << 40);
+
+	wrong = 0;
+	for(uint64_t i=oldest; i<next; ++i)
+	{
+		Value* pValue = churn.Hash(i);
+		if(pValue == NULL || pValue->dwData != i)
+			++wrong;
+	}
+	printf("churn: %d phases, capacity: %.02f%%, wrong: %lu, miss: %.1f ns fresh, %.1f ns at phase %d, %.1f ns at phase %d, %s\n",
+		CHURN_PHASES, churn.Capacity() * 100, wrong, fresh, before, CHURN_WARMUP, after, CHURN_PHASES,
+		after < before * 1.5?"flat":"degraded");
+
+	churn.Delete();
+	churnSeed.Release();
+	return 0;
+}
+
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "cachehashtable.hpp"
+
+#define KEY_SPACE		1000000
+#define REQUEST_COUNT	5000000
+#define PHASE_COUNT		5
+
+struct Value
+{
+	uint64_t	ddwKey;
+} __attribute__((packed));
+
+struct EvictCounter
+{
+	uint64_t*	pCount;
+
+	void operator()(uint64_t keyValue, Value* pValue)
+	{
+		++*pCount;
+	}
+};
+
+int main(int argc, char* argv[])
+{
+	// a cache for 5% of the key space
+	Seed seed(KEY_SPACE / 20 / 10, 10);
+	HashTable<uint64_t, Value> ht = HashTable<uint64_t, Value>::CreateHashTable(seed);
+	CacheHashTable<uint64_t, Value> cht = CacheHashTable<uint64_t, Value>::CreateHashTable(seed);
+	seed.Release();
+
+	// skewed requests, small keys of a phase are far more popular, and the
+	// popular keys move to a new range every phase
+	std::vector<uint64_t> vRequest(REQUEST_COUNT);
+	for(size_t i=0; i<vRequest.size(); ++i)
+		vRequest[i] = (uint64_t)KEY_SPACE * (i / (REQUEST_COUNT / PHASE_COUNT)) +
+						(uint64_t)pow(KEY_SPACE, (double)random() / RAND_MAX);
+
+	uint64_t hit = 0;
+	uint64_t lost = 0;
+	for(size_t i=0; i<vRequest.size(); ++i)
+	{
+		if(ht.Hash(vRequest[i]))
+			++hit;
+		else if(!ht.Hash(vRequest[i], true))
+			++lost;
+	}
+	printf("HashTable      hit rate: %.02f%%, lost inserts: %lu\n", hit * 100.0 / vRequest.size(), lost);
+
+	hit = 0;
+	uint64_t evicted = 0;
+	EvictCounter counter = { &evicted };
+	for(size_t i=0; i<vRequest.size(); ++i)
+	{
+		Value* pValue = cht.Hash(vRequest[i]);
+		if(pValue && pValue->ddwKey == vRequest[i])
+		{
+			++hit;
+			continue;
+		}
+
+		pValue = cht.Hash(vRequest[i], true, counter);
+		if(pValue)
+			pValue->ddwKey = vRequest[i];
+	}
+	printf("CacheHashTable hit rate: %.02f%%, evicted: %lu, capacity: %.02f%%\n",
+			hit * 100.0 / vRequest.size(), evicted, cht.Capacity() * 100);
+
+	ht.Delete();
+	cht.Delete();
+	return 0;
+}
+
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "compacthashtable.hpp"
+
+struct Value
+{
+	uint32_t	dwData;
+} __attribute__((packed));
+
+// millisecond expire times
+typedef CompactTimerHashTable<uint64_t, Value, void, MicroSecondTimeProvider, 1000> SessionTable;
+
+int main(int argc, char* argv[])
+{
+	printf("node size: HashTable %lu, CompactHashTable %lu\n",
+			HashTable<uint64_t, Value>::GetNodeSize(), CompactHashTable<uint64_t, Value>::GetNodeSize());
+	printf("node size: TimerHashTable<MicroSecondTimeProvider> %lu, CompactTimerHashTable %lu\n",
+			TimerHashTable<uint64_t, Value, void, MicroSecondTimeProvider>::GetNodeSize(), SessionTable::GetNodeSize());
+
+	Seed seed(100000, 10);
+	CompactHashTable<uint64_t, Value> cht = CompactHashTable<uint64_t, Value>::CreateHashTable(seed);
+	SessionTable sessions = SessionTable::CreateHashTable(seed);
+	seed.Release();
+
+	// sequential keys share rows, the fingerprint still tells them apart
+	uint64_t key = 1;
+	for(; cht.Capacity() < 0.7; ++key)
+	{
+		Value* pValue = cht.Hash(key, true);
+		if(pValue == NULL)
+			break;
+		pValue->dwData = key;
+	}
+
+	size_t wrong = 0;
+	for(uint64_t i=1; i<key; ++i)
+	{
+		Value* pValue = cht.Hash(i);
+		if(pValue == NULL || pValue->dwData != i)
+			++wrong;
+	}
+	printf("keys: %lu, capacity: %.02f%%, wrong: %lu\n", key - 1, cht.Capacity() * 100, wrong);
+
+	timeval timeout = { 60, 0 };
+	sessions.SetDefaultTimeout(timeout);
+	for(uint64_t i=1; i<=1000; ++i)
+		sessions.Hash(i, true)->dwData = i;
+
+	// expire the first half right away
+	timeval now;
+	gettimeofday(&now, NULL);
+	for(uint64_t i=1; i<=500; ++i)
+		sessions.Expire(i, now);
+
+	size_t alive = 0;
+	HashTableIterator iter;
+	while(sessions.Next(&iter))
+		++alive;
+
+	timeval ttl = sessions.TTL(1000);
+	printf("sessions alive: %lu, ttl of 1000: %ld.%03lds\n", alive, (long)ttl.tv_sec, (long)ttl.tv_usec / 1000);
+
+	cht.Delete();
+	sessions.Delete();
+	return 0;
+}
+
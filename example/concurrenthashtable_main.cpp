@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "concurrenthashtable.hpp"
+
+#define READER_COUNT	4
+#define WRITER_COUNT	4
+#define KEY_COUNT		1000
+
+struct Value
+{
+	uint64_t	ddwVersion;
+	char		sName[16];
+	uint64_t	ddwCheck;
+} __attribute__((packed));
+
+struct Counter
+{
+	uint32_t	dwHits;
+	uint32_t	dwLast;
+} __attribute__((packed));
+
+SeqLockHashTable<uint64_t, Value> g_SeqLockTable;
+AtomicHashTable<uint64_t, Counter> g_AtomicTable;
+volatile bool g_Stop = false;
+
+void* ReaderThread(void* arg)
+{
+	uint64_t ddwRead = 0;
+	uint64_t ddwTorn = 0;
+	while(!g_Stop)
+	{
+		for(uint64_t key=1; key<=KEY_COUNT; ++key)
+		{
+			Value value;
+			if(!g_SeqLockTable.Get(key, &value))
+				continue;
+
+			++ddwRead;
+			if(value.ddwCheck != ~value.ddwVersion)
+				++ddwTorn;
+		}
+	}
+	printf("reader read: %lu, torn: %lu\n", ddwRead, ddwTorn);
+	return NULL;
+}
+
+void* WriterThread(void* arg)
+{
+	uint32_t id = (uint32_t)(uintptr_t)arg;
+	for(uint32_t i=0; i<100000; ++i)
+	{
+		uint64_t key = i % KEY_COUNT + 1;
+		g_AtomicTable.FetchAdd(key, &Counter::dwHits, (uint32_t)1);
+
+		uint32_t last = 0;
+		g_AtomicTable.CompareExchange(key, &Counter::dwLast, last, id, &last);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	Seed seed(KEY_COUNT * 2, 8);
+	g_SeqLockTable = SeqLockHashTable<uint64_t, Value>::CreateHashTable(seed);
+	seed.Release();
+
+	pthread_t readers[READER_COUNT];
+	for(int i=0; i<READER_COUNT; ++i)
+		pthread_create(&readers[i], NULL, ReaderThread, NULL);
+
+	// single writer
+	for(uint64_t version=0; version<1000000; ++version)
+	{
+		Value value;
+		memset(&value, 0, sizeof(Value));
+		value.ddwVersion = version;
+		value.ddwCheck = ~version;
+		snprintf(value.sName, sizeof(value.sName), "%lu", version);
+
+		g_SeqLockTable.Set(version % KEY_COUNT + 1, value);
+	}
+	g_Stop = true;
+
+	for(int i=0; i<READER_COUNT; ++i)
+		pthread_join(readers[i], NULL);
+
+	printf("capacity: %.02f%%\n", g_SeqLockTable.Capacity() * 100);
+
+	// many writers
+	seed = Seed(KEY_COUNT * 2, 8);
+	g_AtomicTable = AtomicHashTable<uint64_t, Counter>::CreateHashTable(seed);
+	seed.Release();
+
+	pthread_t writers[WRITER_COUNT];
+	for(int i=0; i<WRITER_COUNT; ++i)
+		pthread_create(&writers[i], NULL, WriterThread, (void*)(uintptr_t)(i + 1));
+	for(int i=0; i<WRITER_COUNT; ++i)
+		pthread_join(writers[i], NULL);
+
+	uint64_t ddwHits = 0;
+	HashTableIterator iter;
+	for(Counter* pCounter = g_AtomicTable.Next(&iter); pCounter; pCounter = g_AtomicTable.Next(&iter))
+		ddwHits += pCounter->dwHits;
+	printf("atomic hits: %lu (expect %u), capacity: %.02f%%\n", ddwHits, WRITER_COUNT * 100000, g_AtomicTable.Capacity() * 100);
+
+	g_SeqLockTable.Delete();
+	g_AtomicTable.Delete();
+	return 0;
+}
+
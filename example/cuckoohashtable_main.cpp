@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "cuckoohashtable.hpp"
+
+struct Value
+{
+	uint64_t	ddwKey;
+} __attribute__((packed));
+
+int main(int argc, char* argv[])
+{
+	Seed seed(100000, 10);
+	HashTable<uint64_t, Value> ht = HashTable<uint64_t, Value>::CreateHashTable(seed);
+	CuckooHashTable<uint64_t, Value> cht = CuckooHashTable<uint64_t, Value>::CreateHashTable(seed);
+	seed.Release();
+
+	// insert until the first failure
+	while(ht.Hash(((uint64_t)random() << 32) | random(), true));
+	printf("HashTable full at capacity: %.02f%%\n", ht.Capacity() * 100);
+
+	std::vector<uint64_t> vKeys;
+	while(true)
+	{
+		uint64_t key = ((uint64_t)random() << 32) | random();
+		Value* pValue = cht.Hash(key, true);
+		if(pValue == NULL)
+			break;
+
+		pValue->ddwKey = key;
+		vKeys.push_back(key);
+	}
+	printf("CuckooHashTable full at capacity: %.02f%%, stash: %u/%u\n",
+			cht.Capacity() * 100, cht.GetStashUsed(), cht.GetStashSize());
+
+	size_t missing = 0;
+	for(size_t i=0; i<vKeys.size(); ++i)
+	{
+		Value* pValue = cht.Hash(vKeys[i]);
+		if(pValue == NULL || pValue->ddwKey != vKeys[i])
+			++missing;
+	}
+	printf("keys: %lu, missing: %lu\n", vKeys.size(), missing);
+
+	ht.Delete();
+	cht.Delete();
+	return 0;
+}
+
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "buckethashtable.hpp"
+
+#define BENCHMARK_COUNT		10000000
+#define BENCHMARK_LOOKUP	1000000
+#define BENCHMARK_ROUND		10
+
+typedef STATICSEED_8(4099, 4093, 4091, 4079, 4073, 4057, 4051, 4049) BenchmarkSeed;
+
+struct Value
+{
+	uint32_t	dwData;
+} __attribute__((packed));
+
+struct ScanCounter
+{
+	uint64_t*	pSum;
+
+	// called from every scan thread, only matching rows touch shared state
+	void operator()(uint64_t keyValue, Value* pValue)
+	{
+		if(pValue->dwData % 16 == 0)
+			AtomicFetchAdd(pSum, (uint64_t)pValue->dwData);
+	}
+};
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000000000.0 + (end.tv_usec - begin.tv_usec) * 1000.0;
+}
+
+template<typename TimeProviderT>
+double TimerLookup(Seed& seed, std::vector<uint64_t>& vKeys, std::vector<uint64_t>& vLookup, TimeProviderT provider, size_t* pFound)
+{
+	TimerHashTable<uint64_t, Value, void, TimeProviderT> tht =
+		TimerHashTable<uint64_t, Value, void, TimeProviderT>::CreateHashTable(seed);
+	tht.SetTimeProvider(provider);
+	tht.SetDefaultTimeout(tht.GetTimeProvider().FromTicks(3600));
+
+	for(size_t k=0; k<vKeys.size() && tht.Capacity() < 0.7; ++k)
+	{
+		Value* pValue = tht.Hash(vKeys[k], true);
+		if(pValue == NULL)
+			break;
+		pValue->dwData = k;
+	}
+
+	timeval begin;
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(tht.Hash(vLookup[k]))
+				++*pFound;
+	double elapsed = Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND);
+
+	tht.Delete();
+	return elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+	Seed seed = StaticHashTable<uint64_t, Value, BenchmarkSeed>::GetSeed();
+	uint32_t* primes = seed.GetSeedBuffer();
+	uint32_t rows = seed.GetSize();
+
+	std::vector<uint64_t> vKeys(BENCHMARK_COUNT);
+	for(size_t i=0; i<vKeys.size(); ++i)
+		vKeys[i] = ((uint64_t)random() << 32) | random();
+
+	// row addressing only: hardware division vs precomputed constants
+	FastModulo modulo[StaticSeedTraits<BenchmarkSeed>::Size];
+	for(uint32_t i=0; i<rows; ++i)
+		modulo[i].Initialize(primes[i]);
+
+	timeval begin;
+	uint64_t sum = 0;
+
+	// row sizes of a large table, found on every process start
+	gettimeofday(&begin, NULL);
+	Seed largeSeed(2000000000, 100);
+	printf("Seed(2000000000, 100)    : %.02f ms\n", Elapsed(begin) / 1000000);
+	largeSeed.Release();
+
+	gettimeofday(&begin, NULL);
+	for(size_t k=0; k<vKeys.size(); ++k)
+		for(uint32_t i=0; i<rows; ++i)
+			sum += vKeys[k] % primes[i];
+	printf("row address (div)        : %.02f ns/key\n", Elapsed(begin) / vKeys.size());
+
+	gettimeofday(&begin, NULL);
+	for(size_t k=0; k<vKeys.size(); ++k)
+		for(uint32_t i=0; i<rows; ++i)
+			sum -= modulo[i].Mod(vKeys[k]);
+	printf("row address (FastModulo) : %.02f ns/key\n", Elapsed(begin) / vKeys.size());
+
+	// power of two rows: mixing hash and a mask
+	uint64_t maskSum = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t k=0; k<vKeys.size(); ++k)
+		for(uint32_t i=0; i<rows; ++i)
+			maskSum += MixRowKey(vKeys[k], i) & 4095;
+	printf("row address (mix & mask) : %.02f ns/key\n", Elapsed(begin) / vKeys.size());
+
+	// cache resident table, every lookup walks all rows (miss)
+	HashTable<uint64_t, Value> ht = HashTable<uint64_t, Value>::CreateHashTable(seed);
+	Seed maskSeed(4096, rows, SEED_POWEROFTWO);
+	HashTable<uint64_t, Value> mht = HashTable<uint64_t, Value>::CreateHashTable(maskSeed);
+	maskSeed.Release();
+	StaticHashTable<uint64_t, Value, BenchmarkSeed> sht = StaticHashTable<uint64_t, Value, BenchmarkSeed>::CreateHashTable();
+	if(!ht.Success() || !mht.Success() || !sht.Success())
+	{
+		printf("error: create hashtable fail.\n");
+		return -1;
+	}
+
+	size_t inserted = 0;
+	for(; inserted<vKeys.size() && ht.Capacity() < 0.7; ++inserted)
+	{
+		Value* pValue = ht.Hash(vKeys[inserted], true);
+		Value* pStaticValue = sht.Hash(vKeys[inserted], true);
+		if(pValue == NULL || pStaticValue == NULL)
+			break;
+		pValue->dwData = pStaticValue->dwData = inserted;
+
+		Value* pMaskValue = mht.Hash(vKeys[inserted], true);
+		if(pMaskValue)
+			pMaskValue->dwData = inserted;
+	}
+
+	// half hits, half misses
+	std::vector<uint64_t> vLookup(BENCHMARK_LOOKUP);
+	for(size_t k=0; k<vLookup.size(); ++k)
+		vLookup[k] = (k % 2)?vKeys[k % inserted]:vKeys[vKeys.size() - 1 - k];
+
+	size_t found = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(ht.Hash(vLookup[k]))
+				++found;
+	printf("HashTable::Hash          : %.02f ns/op\n", Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND));
+
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(sht.Hash(vLookup[k]))
+				--found;
+	printf("StaticHashTable::Hash    : %.02f ns/op\n", Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND));
+
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(mht.Hash(vLookup[k]))
+				++maskSum;
+	printf("HashTable::Hash (2^n)    : %.02f ns/op, capacity: %.02f%%\n",
+			Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND), mht.Capacity() * 100);
+
+	// same nodes in 16 slot buckets, a miss reads one tag group
+	BucketHashTable<uint64_t, Value> bht = BucketHashTable<uint64_t, Value>::CreateHashTable(seed);
+	for(size_t k=0; k<inserted; ++k)
+	{
+		Value* pValue = bht.Hash(vKeys[k], true);
+		if(pValue)
+			pValue->dwData = k;
+	}
+
+	size_t bucketFound = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(bht.Hash(vLookup[k]))
+				++bucketFound;
+	printf("BucketHashTable::Hash    : %.02f ns/op, capacity: %.02f%%\n",
+			Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND), bht.Capacity() * 100);
+
+	// and filled up to where the row tables fail their inserts
+	for(size_t k=inserted; k<vKeys.size() && bht.Capacity() < 0.9; ++k)
+		bht.Hash(vKeys[k], true);
+
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vLookup.size(); ++k)
+			if(bht.Hash(vLookup[k]))
+				--bucketFound;
+	printf("BucketHashTable (90%%)    : %.02f ns/op\n", Elapsed(begin) / (vLookup.size() * BENCHMARK_ROUND));
+	bht.Delete();
+
+	// TimerHashTable lookups with the clock read per call, coarse, and
+	// cached by a ticker thread
+	size_t timerFound = 0;
+	printf("TimerHashTable (time)    : %.02f ns/op\n",
+			TimerLookup(seed, vKeys, vLookup, SecondTimeProvider(), &timerFound));
+	printf("TimerHashTable (coarse)  : %.02f ns/op\n",
+			TimerLookup(seed, vKeys, vLookup, CoarseSecondTimeProvider(), &timerFound));
+
+	volatile uint64_t clock = 0;
+	TimeTicker<SecondTimeProvider> ticker;
+	ticker.Start(&clock, 1000);
+	printf("TimerHashTable (cached)  : %.02f ns/op\n",
+			TimerLookup(seed, vKeys, vLookup, CachedTimeProvider<SecondTimeProvider>(&clock), &timerFound));
+	ticker.Stop();
+
+	// full table scan of a memory resident table: one thread, partitioned
+	// threads, and skipping empty blocks through the occupancy counters
+	Seed scanSeed(250000, 20);
+	HashTable<uint64_t, Value> scanTable = HashTable<uint64_t, Value>::CreateHashTable(scanSeed);
+	scanSeed.Release();
+
+	size_t scanInserted = 0;
+	for(; scanInserted<vKeys.size() && scanTable.Capacity() < 0.6; ++scanInserted)
+	{
+		Value* pValue = scanTable.Hash(vKeys[scanInserted], true);
+		if(pValue == NULL)
+			break;
+		pValue->dwData = scanInserted;
+	}
+
+	// lookups in the memory resident table, one Hash() at a time and in
+	// HashMany() batches that prefetch the rows of every key first
+	std::vector<uint64_t> vScanLookup(BENCHMARK_LOOKUP);
+	for(size_t k=0; k<vScanLookup.size(); ++k)
+		vScanLookup[k] = (k % 2)?vKeys[(k * 7919) % scanInserted]:vKeys[vKeys.size() - 1 - k];
+
+	size_t manyFound = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		for(size_t k=0; k<vScanLookup.size(); ++k)
+			if(scanTable.Hash(vScanLookup[k]))
+				++manyFound;
+	printf("Hash loop (memory)       : %.02f ns/op\n", Elapsed(begin) / (vScanLookup.size() * BENCHMARK_ROUND));
+
+	std::vector<Value*> vResults(vScanLookup.size());
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<BENCHMARK_ROUND; ++round)
+		manyFound -= scanTable.HashMany(&vScanLookup[0], vScanLookup.size(), &vResults[0]);
+	printf("HashMany (memory)        : %.02f ns/op\n", Elapsed(begin) / (vScanLookup.size() * BENCHMARK_ROUND));
+
+	uint64_t scan = 0;
+	gettimeofday(&begin, NULL);
+	HashTableIterator iter;
+	for(Value* pValue = scanTable.Next(&iter); pValue; pValue = scanTable.Next(&iter))
+		if(pValue->dwData % 16 == 0)
+			scan += pValue->dwData;
+	printf("HashTable::Next          : %.02f ms\n", Elapsed(begin) / 1000000);
+
+	uint64_t parallelScan = 0;
+	ScanCounter counter = { &parallelScan };
+	gettimeofday(&begin, NULL);
+	scanTable.ParallelForEach(counter, 4);
+	printf("ParallelForEach(4)       : %.02f ms\n", Elapsed(begin) / 1000000);
+
+	// drop 90% of the keys, then scan with the occupancy counters
+	std::vector<uint8_t> vOccupancy(scanTable.GetOccupancySize());
+	scanTable.AttachOccupancy(&vOccupancy[0], vOccupancy.size());
+	for(size_t k=0; k<scanInserted; ++k)
+		if(k % 10 != 0)
+			scanTable.Clear(vKeys[k]);
+
+	uint64_t sparseScan = 0;
+	counter.pSum = &sparseScan;
+	gettimeofday(&begin, NULL);
+	scanTable.ParallelForEach(counter, 4);
+	printf("ParallelForEach(4) sparse: %.02f ms\n", Elapsed(begin) / 1000000);
+
+	printf("checksum: %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu\n", sum, found, maskSum, timerFound, bucketFound, manyFound, scan - parallelScan, sparseScan);
+
+	ht.Delete();
+	mht.Delete();
+	sht.Delete();
+	scanTable.Delete();
+	seed.Release();
+	return 0;
+}
+
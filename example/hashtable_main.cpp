@@ -36,6 +36,25 @@ struct Value
 	double		dAmount;
 } __attribute__((packed));
 
+// orders of a user all translate to the user id, so they collide
+struct OrderKey
+{
+	uint32_t	dwUserId;
+	uint32_t	dwOrderId;
+};
+
+template<>
+struct KeyTranslate<OrderKey>
+{
+	typedef OrderKey KeyType;
+	typedef uint64_t HeadType;
+
+	static inline uint64_t Translate(OrderKey key)
+	{
+		return key.dwUserId;
+	}
+};
+
 struct A
 {
 	bool isred;
@@ -60,6 +79,22 @@ int main(int argc, char* argv[])
 	HashTable<Key&, Value> ht = HashTable<Key&, Value>::LoadHashTable(fs, seed);
     seed.Release();
 
+	// batched lookup: the first key is inserted, the second is not
+	Key keys[2];
+	memset(keys, 0, sizeof(keys));
+	keys[0].dwUserId = 1;
+	keys[0].dwOrderId = 1;
+	keys[1].dwUserId = 2;
+	keys[1].dwOrderId = 2;
+	Value* pInserted = ht.Hash(keys[0], true);
+	if(pInserted)
+		strcpy(pInserted->sName, "batched");
+
+	Value* results[2];
+	size_t found = ht.HashMany(keys, 2, results);
+	printf("hash many found: %lu, first: %s, second: %s\n", found,
+			results[0]?results[0]->sName:"-", results[1]?"found":"missing");
+
 	uint32_t i=0;
 	for(; i<5000; ++i)
 	{
@@ -84,6 +119,39 @@ int main(int argc, char* argv[])
 	// dump hashtable buffer
 	ht.Dump();
 
+	// keys are verified in full, not only by their 64 bit hash
+	Seed vseed(1000, 10);
+	VerifiedHashTable<Key&, Value> vht = VerifiedHashTable<Key&, Value>::CreateHashTable(vseed);
+	vseed.Release();
+
+	Key vkey;
+	memset(&vkey, 0, sizeof(Key));
+	vkey.dwUserId = 2657910038;
+	vkey.dwOrderId = 2000;
+	strcpy(vht.Hash(vkey, true)->sName, "verified");
+
+	HashTableIterator iter;
+	Key outKey;
+	for(Value* pItem = vht.Next(&iter, &outKey); pItem; pItem = vht.Next(&iter, &outKey))
+		printf("key:(%u, %u) name: %s\n", outKey.dwUserId, outKey.dwOrderId, pItem->sName);
+	vht.Delete();
+
+	// two keys with the same head key keep their own values
+	Seed cseed(1000, 10);
+	VerifiedHashTable<OrderKey, Value> cht = VerifiedHashTable<OrderKey, Value>::CreateHashTable(cseed);
+	cseed.Release();
+
+	OrderKey first = { 1000, 1 };
+	OrderKey second = { 1000, 2 };
+	strcpy(cht.Hash(first, true)->sName, "first");
+	strcpy(cht.Hash(second, true)->sName, "second");
+	printf("colliding keys: %s, %s\n", cht.Hash(first)->sName, cht.Hash(second)->sName);
+
+	cht.Clear(first);
+	Value* pSecond = cht.Hash(second);
+	printf("after clear: first %s, second %s\n", cht.Hash(first)?"found":"missing", pSecond?pSecond->sName:"missing");
+	cht.Delete();
+
 	fs.Release();
 	return 0;
 }
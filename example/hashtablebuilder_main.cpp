@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+// builds a HashTable<uint64_t, uint64_t> file from "key value" lines with
+// HashTable::BulkLoad. Numeric keys are used as they are, other keys are
+// hashed like std::string keys; a missing value is 0. The file loads with
+// HashTable<..>::LoadHashTable(storage, Seed(prime, rows)).
+
+typedef HashTable<uint64_t, uint64_t> IndexTable;
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000.0 + (end.tv_usec - begin.tv_usec) / 1000.0;
+}
+
+bool ReadNodes(FILE* fp, std::vector<IndexTable::NodeType>* pNodes)
+{
+	char line[4096];
+	while(fgets(line, sizeof(line), fp))
+	{
+		size_t len = strcspn(line, "\r\n");
+		line[len] = 0;
+
+		size_t keyLen = strcspn(line, " \t");
+		if(keyLen == 0)
+			continue;
+
+		char* end = NULL;
+		IndexTable::NodeType node;
+		node.Key.KeyValue = strtoull(line, &end, 10);
+		if(end != line + keyLen || node.Key.KeyValue == 0)
+			node.Key.KeyValue = KeyTranslate<std::string>::Translate(std::string(line, keyLen));
+		node.Value = (keyLen < len)?strtoull(line + keyLen + 1, NULL, 10):0;
+		pNodes->push_back(node);
+	}
+	return !pNodes->empty();
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 5)
+	{
+		printf("usage: %s <key value file|-> <output file> <prime> <row count> [threads]\n", argv[0]);
+		return -1;
+	}
+
+	struct stat fileStat;
+	if(stat(argv[2], &fileStat) == 0)
+	{
+		printf("error: %s exists.\n", argv[2]);
+		return -1;
+	}
+
+	uint32_t threads = (argc > 5)?strtoul(argv[5], NULL, 10):sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads == 0)
+		threads = 1;
+
+	timeval begin;
+	gettimeofday(&begin, NULL);
+
+	FILE* fp = strcmp(argv[1], "-")?fopen(argv[1], "r"):stdin;
+	if(!fp)
+	{
+		printf("error: open %s fail.\n", argv[1]);
+		return -1;
+	}
+
+	std::vector<IndexTable::NodeType> vNodes;
+	bool bRead = ReadNodes(fp, &vNodes);
+	if(fp != stdin)
+		fclose(fp);
+	if(!bRead)
+	{
+		printf("error: no records.\n");
+		return -1;
+	}
+	printf("read %lu records: %.02f ms\n", vNodes.size(), Elapsed(begin));
+
+	Seed seed(strtoul(argv[3], NULL, 10), strtoul(argv[4], NULL, 10));
+	MapStorage fs;
+	if(seed.GetSize() == 0 || MapStorage::OpenStorage(&fs, argv[2], IndexTable::GetBufferSize(seed)) < 0)
+	{
+		printf("error: open %s fail.\n", argv[2]);
+		return -1;
+	}
+
+	IndexTable ht = IndexTable::LoadHashTable(fs, seed);
+	if(!ht.Success())
+	{
+		printf("error: load hashtable fail.\n");
+		return -1;
+	}
+
+	gettimeofday(&begin, NULL);
+	size_t left = ht.BulkLoad(&vNodes[0], vNodes.size(), threads);
+	printf("load with %u threads: %.02f ms, capacity: %.02f%%, keys left: %lu\n",
+			threads, Elapsed(begin), ht.Capacity() * 100, left);
+
+	fs.Release();
+	seed.Release();
+	return left?1:0;
+}
+
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "incrementalhashtable.hpp"
+
+#define KEY_COUNT		200000
+
+struct Value
+{
+	uint64_t	ddwKey;
+	uint32_t	dwCount;
+} __attribute__((packed));
+
+int main(int argc, char* argv[])
+{
+	Seed seed(KEY_COUNT / 64, 20);
+	IncrementalHashTable<uint64_t, Value> iht(HashTable<uint64_t, Value>::CreateHashTable(seed));
+	seed.Release();
+	if(!iht.Success())
+	{
+		printf("error: create hashtable fail.\n");
+		return -1;
+	}
+
+	uint64_t ddwMaxUsec = 0;
+	uint64_t key = 1;
+	for(; key<=KEY_COUNT; ++key)
+	{
+		// grow into a table 8 times larger before the current one fills up
+		if(!iht.IsMigrating() && iht.Capacity() > 0.6)
+		{
+			Seed newSeed(KEY_COUNT / 8, 20);
+			if(!iht.Grow(HashTable<uint64_t, Value>::CreateHashTable(newSeed)))
+			{
+				printf("error: grow hashtable fail.\n");
+				break;
+			}
+			printf("grow at key %lu\n", key);
+			newSeed.Release();
+		}
+
+		timeval begin, end;
+		gettimeofday(&begin, NULL);
+		Value* pValue = iht.Hash(key, true);
+		gettimeofday(&end, NULL);
+		if(pValue == NULL)
+		{
+			printf("error: hashtable full at key %lu.\n", key);
+			break;
+		}
+		pValue->ddwKey = key;
+		++pValue->dwCount;
+
+		uint64_t ddwUsec = (end.tv_sec - begin.tv_sec) * 1000000 + end.tv_usec - begin.tv_usec;
+		if(ddwUsec > ddwMaxUsec)
+			ddwMaxUsec = ddwUsec;
+	}
+
+	// finish whatever is left from an idle loop
+	while(iht.Migrate(1024) > 0);
+
+	uint64_t ddwMissing = 0;
+	for(uint64_t k=1; k<key; ++k)
+	{
+		Value* pValue = iht.Hash(k);
+		if(pValue == NULL || pValue->ddwKey != k || pValue->dwCount != 1)
+			++ddwMissing;
+	}
+
+	printf("keys: %lu, missing: %lu, max insert: %lu us, capacity: %.02f%%\n",
+			key - 1, ddwMissing, ddwMaxUsec, iht.Capacity() * 100);
+
+	iht.Delete();
+	return 0;
+}
+
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "perfecthashtable.hpp"
+
+#define LOOKUP_ROUND	10
+
+struct Value
+{
+	uint32_t	dwData;
+} __attribute__((packed));
+
+double Elapsed(timeval& begin)
+{
+	timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - begin.tv_sec) * 1000000000.0 + (end.tv_usec - begin.tv_usec) * 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	Seed seed(100000, 20);
+	HashTable<uint64_t, Value> ht = HashTable<uint64_t, Value>::CreateHashTable(seed);
+	size_t hashTableSize = HashTable<uint64_t, Value>::GetBufferSize(seed);
+	seed.Release();
+
+	std::vector<uint64_t> vKeys;
+	while(ht.Capacity() < 0.6)
+	{
+		uint64_t key = ((uint64_t)random() << 32) | random();
+		Value* pValue = ht.Hash(key, true);
+		if(pValue == NULL)
+			break;
+		pValue->dwData = vKeys.size();
+		vKeys.push_back(key);
+	}
+
+	// offline: snapshot the table and write the perfect hash table to a file
+	timeval begin;
+	gettimeofday(&begin, NULL);
+	PerfectHashTableBuilder<uint64_t, Value> builder;
+	builder.Append(ht);
+
+	MapStorage fs;
+	if(MapStorage::OpenStorage(&fs, "./perfect.data", builder.GetBufferSize()) < 0 || !builder.Build(fs))
+	{
+		printf("error: build perfect hashtable fail.\n");
+		return -1;
+	}
+	fs.Flush();
+	printf("build %lu keys: %.02f ms\n", builder.GetCount(), Elapsed(begin) / 1000000);
+	builder.Clear();
+
+	// online: load it read only
+	PerfectHashTable<uint64_t, Value> pht = PerfectHashTable<uint64_t, Value>::LoadHashTable(fs);
+	if(!pht.Success())
+	{
+		printf("error: load perfect hashtable fail.\n");
+		return -1;
+	}
+
+	size_t wrong = 0;
+	for(size_t i=0; i<vKeys.size(); ++i)
+	{
+		Value* pValue = pht.Hash(vKeys[i]);
+		if(pValue == NULL || pValue->dwData != i)
+			++wrong;
+		if(pht.Hash(vKeys[i] + 1) != NULL && ht.Hash(vKeys[i] + 1) == NULL)
+			++wrong;
+	}
+	printf("keys: %u, wrong: %lu\n", pht.GetCount(), wrong);
+	printf("size: HashTable %lu bytes, PerfectHashTable %lu bytes\n",
+			hashTableSize, fs.GetSize());
+
+	size_t found = 0;
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<LOOKUP_ROUND; ++round)
+		for(size_t i=0; i<vKeys.size(); ++i)
+			if(ht.Hash(vKeys[i]))
+				++found;
+	printf("HashTable::Hash        : %.02f ns/op\n", Elapsed(begin) / (vKeys.size() * LOOKUP_ROUND));
+
+	gettimeofday(&begin, NULL);
+	for(size_t round=0; round<LOOKUP_ROUND; ++round)
+		for(size_t i=0; i<vKeys.size(); ++i)
+			if(pht.Hash(vKeys[i]))
+				--found;
+	printf("PerfectHashTable::Hash : %.02f ns/op\n", Elapsed(begin) / (vKeys.size() * LOOKUP_ROUND));
+	printf("checksum: %lu\n", found);
+
+	ht.Delete();
+	fs.Release();
+	return 0;
+}
+
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "concurrenthashtable.hpp"
+#include "ratelimiter.hpp"
+
+#define PROCESS_COUNT	4
+#define KEY_COUNT		100
+#define BURST			10
+#define RATE			5
+
+typedef RateLimiter<uint64_t, TokenBucketPolicy> Limiter;
+
+int main(int argc, char* argv[])
+{
+	Seed seed(KEY_COUNT * 2, 8);
+	TokenBucketPolicy policy(RATE, BURST);
+
+	unlink("./ratelimiter.data");
+	MapStorage fs;
+	if(MapStorage::OpenStorage(&fs, "./ratelimiter.data", Limiter::GetBufferSize(seed)) < 0)
+	{
+		printf("error: open storage fail.\n");
+		return -1;
+	}
+	Limiter limiter = Limiter::LoadRateLimiter(fs, seed, policy);
+	if(!limiter.Success())
+	{
+		printf("error: load ratelimiter fail.\n");
+		return -1;
+	}
+
+	// every process hammers the same keys at the same instant, so no token
+	// is refilled and exactly BURST requests per key get through. Each
+	// process sends its count of allowed requests back through a pipe.
+	int fds[2];
+	if(pipe(fds) < 0)
+	{
+		printf("error: pipe fail.\n");
+		return -1;
+	}
+
+	uint64_t now = 1000000000000ULL;
+	for(int i=0; i<PROCESS_COUNT; ++i)
+	{
+		if(fork() != 0)
+			continue;
+
+		MapStorage childStorage;
+		MapStorage::OpenStorage(&childStorage, "./ratelimiter.data", Limiter::GetBufferSize(seed));
+		Limiter child = Limiter::LoadRateLimiter(childStorage, seed, policy);
+		uint64_t allowed = 0;
+		for(int round=0; round<1000; ++round)
+		{
+			for(uint64_t key=1; key<=KEY_COUNT; ++key)
+			{
+				if(child.Acquire(key, 1, now))
+					++allowed;
+			}
+		}
+		write(fds[1], &allowed, sizeof(allowed));
+		childStorage.Release();
+		exit(0);
+	}
+	close(fds[1]);
+
+	uint64_t total = 0;
+	for(int i=0; i<PROCESS_COUNT; ++i)
+	{
+		uint64_t allowed = 0;
+		if(read(fds[0], &allowed, sizeof(allowed)) == sizeof(allowed))
+			total += allowed;
+		wait(NULL);
+	}
+	close(fds[0]);
+
+	printf("allowed: %lu (expect %u)\n", total, KEY_COUNT * BURST);
+	printf("available after 1s: %u (expect %u)\n", limiter.Available(1, now + 1000000), RATE);
+
+	size_t reclaimed = limiter.Reclaim((size_t)-1, now + 2000000);
+	printf("reclaimed after 2s: %lu, capacity: %.02f%%\n", reclaimed, limiter.Capacity() * 100);
+
+	// 100 per sliding second, asked for 1000 times a second
+	Seed windowSeed(16, 2);
+	RateLimiter<uint64_t, SlidingWindowPolicy> window =
+		RateLimiter<uint64_t, SlidingWindowPolicy>::CreateRateLimiter(windowSeed, SlidingWindowPolicy(100, 1000000));
+	windowSeed.Release();
+
+	size_t allowed = 0;
+	for(uint64_t ms=0; ms<5000; ++ms)
+	{
+		if(window.Acquire(1, 1, now + ms * 1000))
+			++allowed;
+	}
+	printf("sliding window allowed in 5s: %lu (expect about 500)\n", allowed);
+
+	window.Delete();
+	fs.Release();
+	seed.Release();
+	unlink("./ratelimiter.data");
+	return 0;
+}
+
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "bitmap.hpp"
+#include "roaringbitmap.hpp"
+
+#define KEY_SPACE		(1ULL << 40)
+#define KEY_COUNT		1000000
+
+typedef RoaringBitmap<uint64_t> IdBitmap;
+
+uint64_t RandomId()
+{
+	return ((uint64_t)random() << 31 ^ random()) % KEY_SPACE;
+}
+
+int main(int argc, char* argv[])
+{
+	IdBitmap seen = IdBitmap::CreateBitmap(KEY_SPACE);
+	IdBitmap active = IdBitmap::CreateBitmap(KEY_SPACE);
+
+	// sparse random ids, plus a dense range of ids issued in a row
+	srandom(time(NULL));
+	for(int i=0; i<KEY_COUNT; ++i)
+		seen.Set(RandomId());
+	for(uint64_t id=1000000; id<1200000; ++id)
+		seen.Set(id);
+	for(uint64_t id=1100000; id<1300000; id+=2)
+		active.Set(id);
+
+	printf("seen: %lu ids, %lu containers, flat Bitmap: %lu bytes, stored: %lu bytes\n",
+			seen.GetCount(), seen.GetContainerCount(), Bitmap<uint64_t>::GetBufferSize(KEY_SPACE), seen.GetBufferSize());
+
+	unlink("./roaringbitmap.data");
+	MapStorage fs;
+	if(MapStorage::OpenStorage(&fs, "./roaringbitmap.data", seen.GetBufferSize()) < 0 || !seen.Store(fs))
+	{
+		printf("error: store bitmap fail.\n");
+		return -1;
+	}
+	fs.Release();
+
+	// query the file in place
+	MapStorage loadStorage;
+	MapStorage::OpenStorage(&loadStorage, "./roaringbitmap.data", seen.GetBufferSize());
+	IdBitmap loaded = IdBitmap::LoadBitmap(loadStorage);
+	if(!loaded.Success())
+	{
+		printf("error: load bitmap fail.\n");
+		return -1;
+	}
+	printf("loaded: %lu ids, contains 1000000: %s, contains 1200000: %s\n", loaded.GetCount(),
+			loaded.Contains(1000000)?"true":"false", loaded.Contains(1200000)?"true":"false");
+
+	active.And(loaded);
+	printf("active & seen: %lu ids (expect 50000)\n", active.GetCount());
+
+	active.Or(loaded);
+	printf("active | seen: %lu ids (expect %lu)\n", active.GetCount(), loaded.GetCount());
+
+	loadStorage.Release();
+	unlink("./roaringbitmap.data");
+	seen.Delete();
+	active.Delete();
+	return 0;
+}
+
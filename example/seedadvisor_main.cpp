@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+// recommends the Seed(prime, count) of a HashTable for a key set: a table
+// scaled to the sample is built for every row count, loaded to the target
+// load factor with the sample keys, and the row count that takes every key
+// with the fewest probes per hit wins. Numeric lines are uint64_t keys,
+// other lines are hashed like std::string keys.
+
+struct Value
+{
+	uint8_t		cData;
+} __attribute__((packed));
+
+static const uint32_t g_RowCounts[] = { 2, 3, 4, 5, 6, 8, 10, 12, 16, 20, 24, 32, 48, 64 };
+
+struct Advice
+{
+	uint32_t	dwCount;
+	uint32_t	dwPrime;
+	double		fLoad;
+	double		fHitProbe;
+	double		fFailRate;
+};
+
+bool ReadKeys(FILE* fp, std::vector<uint64_t>* pKeys)
+{
+	char line[4096];
+	while(fgets(line, sizeof(line), fp))
+	{
+		size_t len = strcspn(line, "\r\n");
+		line[len] = 0;
+		if(len == 0)
+			continue;
+
+		char* end = NULL;
+		uint64_t key = strtoull(line, &end, 10);
+		if(*end != 0 || key == 0)
+			key = KeyTranslate<std::string>::Translate(std::string(line, len));
+		pKeys->push_back(key);
+	}
+	return !pKeys->empty();
+}
+
+// smallest seed whose count primes hold nodes nodes, the primes step down
+// from the seed so count * seed alone falls short for small rows
+uint32_t FitPrime(uint64_t nodes, uint32_t count)
+{
+	uint32_t prime = (nodes + count - 1) / count;
+	while(true)
+	{
+		Seed seed(prime, count);
+		uint64_t total = (seed.GetSize() == count)?seed.GetCount():0;
+		seed.Release();
+
+		if(total >= nodes)
+			return prime;
+		prime += (nodes - total + count - 1) / count;
+	}
+}
+
+Advice Evaluate(std::vector<uint64_t>& vKeys, uint32_t count, double load)
+{
+	Advice advice = { count, 0, 0, 0, 0 };
+
+	uint32_t prime = FitPrime((uint64_t)ceil(vKeys.size() / load), count);
+	Seed seed(prime, count);
+	HashTable<uint64_t, Value> ht = HashTable<uint64_t, Value>::CreateHashTable(seed);
+	seed.Release();
+	if(!ht.Success())
+		return advice;
+
+	HashTableStatistics stats;
+	ht.AttachStatistics(&stats);
+
+	for(size_t i=0; i<vKeys.size(); ++i)
+		ht.Hash(vKeys[i], true);
+
+	// look every key up once more, the hit rows are the probe depth
+	uint64_t inserted = 0;
+	for(uint32_t i=0; i<count; ++i)
+		inserted += stats.ddwInsert[i];
+	for(uint32_t i=0; i<count; ++i)
+		stats.ddwHit[i] = 0;
+	for(size_t i=0; i<vKeys.size(); ++i)
+		ht.Hash(vKeys[i]);
+
+	uint64_t hits = 0;
+	uint64_t probes = 0;
+	for(uint32_t i=0; i<count; ++i)
+	{
+		hits += stats.ddwHit[i];
+		probes += stats.ddwHit[i] * (i + 1);
+	}
+
+	advice.dwPrime = prime;
+	advice.fLoad = ht.Capacity();
+	advice.fHitProbe = hits?(double)probes / hits:0;
+	advice.fFailRate = (double)stats.ddwInsertFail / (inserted + stats.ddwInsertFail);
+	ht.Delete();
+	return advice;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		printf("usage: %s <key file|-> <load factor> [key count]\n", argv[0]);
+		return -1;
+	}
+
+	FILE* fp = strcmp(argv[1], "-")?fopen(argv[1], "r"):stdin;
+	if(!fp)
+	{
+		printf("error: open %s fail.\n", argv[1]);
+		return -1;
+	}
+
+	std::vector<uint64_t> vKeys;
+	bool bRead = ReadKeys(fp, &vKeys);
+	if(fp != stdin)
+		fclose(fp);
+	if(!bRead)
+	{
+		printf("error: no keys.\n");
+		return -1;
+	}
+
+	double load = atof(argv[2]);
+	uint64_t keyCount = (argc > 3)?strtoull(argv[3], NULL, 10):vKeys.size();
+	if(load <= 0 || load > 1 || keyCount == 0)
+	{
+		printf("error: bad load factor or key count.\n");
+		return -1;
+	}
+
+	// the sample goes into a copy of the real table scaled down to its size
+	uint64_t nodes = (uint64_t)ceil(keyCount / load);
+
+	printf("%-6s %-12s %-8s %-10s %-10s\n", "rows", "prime", "load", "probe/hit", "fail");
+	Advice best = { 0, 0, 0, 0, 0 };
+	for(size_t i=0; i<sizeof(g_RowCounts)/sizeof(uint32_t); ++i)
+	{
+		if(g_RowCounts[i] > HASHTABLE_SEED_MAX)
+			break;
+
+		Advice advice = Evaluate(vKeys, g_RowCounts[i], load);
+		if(advice.dwPrime == 0)
+			continue;
+
+		printf("%-6u %-12u %-8.04f %-10.04f %-10.06f\n", advice.dwCount,
+				FitPrime(nodes, advice.dwCount), advice.fLoad, advice.fHitProbe, advice.fFailRate);
+
+		if(advice.fFailRate == 0 && (best.dwCount == 0 || advice.fHitProbe < best.fHitProbe))
+			best = advice;
+	}
+
+	if(best.dwCount == 0)
+	{
+		printf("no row count holds every key at load %.02f, lower the load factor.\n", load);
+		return 1;
+	}
+
+	printf("recommend: Seed(%u, %u), %.04f probes per hit, %u probes per miss\n",
+			FitPrime(nodes, best.dwCount), best.dwCount, best.fHitProbe, best.dwCount);
+	return 0;
+}
+
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <utility>
+#include <vector>
+#include <string>
+#include "utility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define KEY_COUNT		100000
+
+// a clock the example can move by hand
+struct ManualTimeProvider :
+	public SecondTimeProvider
+{
+	static time_t Clock;
+
+	inline TimeType Now()
+	{
+		return Clock;
+	}
+};
+time_t ManualTimeProvider::Clock = 1000;
+
+struct Value
+{
+	uint64_t	ddwSessionId;
+} __attribute__((packed));
+
+struct EvictCounter
+{
+	uint64_t*	pCount;
+
+	void operator()(uint64_t keyValue, Value* pValue)
+	{
+		++*pCount;
+	}
+};
+
+int main(int argc, char* argv[])
+{
+	Seed seed(KEY_COUNT / 5, 10);
+	TimerHashTable<uint64_t, Value, void, ManualTimeProvider> tht =
+		TimerHashTable<uint64_t, Value, void, ManualTimeProvider>::CreateHashTable(seed);
+	seed.Release();
+
+	// 1 second buckets, 64 seconds around the wheel
+	std::vector<char> vExpiry(tht.GetExpirySize(64));
+	tht.AttachExpiry(&vExpiry[0], vExpiry.size(), 64, 1);
+
+	// sessions live between 1 and 300 seconds
+	for(uint64_t key=1; key<=KEY_COUNT; ++key)
+	{
+		tht.SetDefaultTimeout(1 + random() % 300);
+		Value* pValue = tht.Hash(key, true);
+		if(pValue == NULL)
+			break;
+		pValue->ddwSessionId = key;
+	}
+	printf("capacity: %.02f%%\n", tht.Capacity() * 100);
+
+	// the owner loop moves the clock and sweeps a slice per step
+	uint64_t ddwEvicted = 0;
+	EvictCounter counter = { &ddwEvicted };
+	for(int step=0; step<400; ++step)
+	{
+		++ManualTimeProvider::Clock;
+
+		bool bDone = false;
+		while(!bDone)
+			tht.Sweep(1000, counter, &bDone);
+
+		if(step % 100 == 99)
+			printf("after %d seconds, evicted: %lu, capacity: %.02f%%\n", step + 1, ddwEvicted, tht.Capacity() * 100);
+	}
+
+	tht.Delete();
+	return 0;
+}
+
@@ -10,7 +10,13 @@
 
 #include <utility>
 #include <string>
+#include <vector>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__BMI2__)
+	#include <immintrin.h>
+#endif
 #include "utility.hpp"
 #include "keyutility.hpp"
 #include "storage.hpp"
@@ -18,6 +24,21 @@
 #define BITMAP_MAGIC    "BITMAP@@"
 #define BITMAP_VERSION  0x0101
 
+// used counters of an AtomicBitmap, one cache line each, a thread adds to
+// the counter its id hashes to
+#define BITMAP_COUNTER_SLOTS	64
+
+// no set bit, returned by NextSetBit() and Select()
+#define BITMAP_NPOS				((uint64_t)-1)
+
+// the rank directory keeps the block of every BITMAP_SELECT_SAMPLE-th set
+// bit, Select() binary searches the blocks between two samples: a few steps
+// where the bits are dense, O(log gap) blocks of 512 bits where two samples
+// lie far apart in a sparse span
+#ifndef BITMAP_SELECT_SAMPLE
+	#define BITMAP_SELECT_SAMPLE	1024
+#endif
+
 template<typename HeadT>
 struct BitmapMeta {
     char cMagic[8];
@@ -47,6 +68,174 @@ struct BitmapMeta<void> {
     uint32_t dwReserved[4];
 } __attribute__((packed));
 
+// word operations of the bulk Bitmap set operations, on 64 bit words and,
+// when built with -mavx2, on 256 bit words
+struct BitmapAnd
+{
+	static inline uint64_t Apply(uint64_t v1, uint64_t v2)
+	{
+		return v1 & v2;
+	}
+#ifdef __AVX2__
+	static inline __m256i Apply(__m256i v1, __m256i v2)
+	{
+		return _mm256_and_si256(v1, v2);
+	}
+#endif
+};
+
+struct BitmapOr
+{
+	static inline uint64_t Apply(uint64_t v1, uint64_t v2)
+	{
+		return v1 | v2;
+	}
+#ifdef __AVX2__
+	static inline __m256i Apply(__m256i v1, __m256i v2)
+	{
+		return _mm256_or_si256(v1, v2);
+	}
+#endif
+};
+
+struct BitmapXor
+{
+	static inline uint64_t Apply(uint64_t v1, uint64_t v2)
+	{
+		return v1 ^ v2;
+	}
+#ifdef __AVX2__
+	static inline __m256i Apply(__m256i v1, __m256i v2)
+	{
+		return _mm256_xor_si256(v1, v2);
+	}
+#endif
+};
+
+struct BitmapAndNot
+{
+	static inline uint64_t Apply(uint64_t v1, uint64_t v2)
+	{
+		return v1 & ~v2;
+	}
+#ifdef __AVX2__
+	static inline __m256i Apply(__m256i v1, __m256i v2)
+	{
+		return _mm256_andnot_si256(v2, v1);
+	}
+#endif
+};
+
+inline uint64_t BitmapLoadWord(const char* p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(uint64_t));
+	return word;
+}
+
+#ifdef __AVX2__
+inline uint64_t BitmapPopCount(__m256i v)
+{
+	return __builtin_popcountll(_mm256_extract_epi64(v, 0)) + __builtin_popcountll(_mm256_extract_epi64(v, 1)) +
+		__builtin_popcountll(_mm256_extract_epi64(v, 2)) + __builtin_popcountll(_mm256_extract_epi64(v, 3));
+}
+#endif
+
+// bits set in size bytes
+inline uint64_t BitmapPopCount(const char* buffer, size_t size)
+{
+	uint64_t count = 0;
+	size_t i = 0;
+#ifdef __AVX2__
+	for(; i+32<=size; i+=32)
+		count += BitmapPopCount(_mm256_loadu_si256((const __m256i*)(buffer + i)));
+#endif
+	for(; i+8<=size; i+=8)
+		count += __builtin_popcountll(BitmapLoadWord(buffer + i));
+	for(; i<size; ++i)
+		count += __builtin_popcount((uint8_t)buffer[i]);
+	return count;
+}
+
+// dst = OpT(dst, src) over size bytes, returns the bits set in dst
+template<typename OpT>
+inline uint64_t BitmapCombine(char* dst, const char* src, size_t size)
+{
+	uint64_t count = 0;
+	size_t i = 0;
+#ifdef __AVX2__
+	for(; i+32<=size; i+=32)
+	{
+		__m256i v = OpT::Apply(_mm256_loadu_si256((const __m256i*)(dst + i)), _mm256_loadu_si256((const __m256i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + i), v);
+		count += BitmapPopCount(v);
+	}
+#endif
+	for(; i+8<=size; i+=8)
+	{
+		uint64_t word = OpT::Apply(BitmapLoadWord(dst + i), BitmapLoadWord(src + i));
+		memcpy(dst + i, &word, sizeof(uint64_t));
+		count += __builtin_popcountll(word);
+	}
+	for(; i<size; ++i)
+	{
+		dst[i] = (char)OpT::Apply((uint8_t)dst[i], (uint8_t)src[i]);
+		count += __builtin_popcount((uint8_t)dst[i]);
+	}
+	return count;
+}
+
+// position of set bit k (from 0) of word
+inline uint32_t BitmapSelectWord(uint64_t word, uint32_t k)
+{
+#ifdef __BMI2__
+	return __builtin_ctzll(_pdep_u64(1ULL << k, word));
+#else
+	// set bits up to and with each byte, then the byte holding bit k
+	uint64_t count = word - ((word >> 1) & 0x5555555555555555ULL);
+	count = (count & 0x3333333333333333ULL) + ((count >> 2) & 0x3333333333333333ULL);
+	count = ((count + (count >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * 0x0101010101010101ULL;
+
+	uint32_t shift = 0;
+	while(((count >> shift) & 0xFF) <= k)
+		shift += 8;
+	if(shift)
+		k -= (count >> (shift - 8)) & 0xFF;
+	for(word >>= shift; k; --k)
+		word &= word - 1;
+	return shift + __builtin_ctzll(word);
+#endif
+}
+
+// rank directory entry of 512 bits: set bits before the block, and set bits
+// before each of its words 1 to 7 in 9 bits each
+struct BitmapRankBlock
+{
+	uint64_t ddwRank;
+	uint64_t ddwRelative;
+} __attribute__((packed));
+
+// one thread of a bulk operation: Combine over its byte range, or only a
+// count when pSrc is NULL
+struct BitmapCombineContext
+{
+	char* pDst;
+	const char* pSrc;
+	size_t ddwSize;
+	uint64_t ddwCount;
+};
+
+template<typename OpT>
+void* BitmapCombineThread(void* arg)
+{
+	BitmapCombineContext* pContext = (BitmapCombineContext*)arg;
+	if(pContext->pSrc)
+		pContext->ddwCount = BitmapCombine<OpT>(pContext->pDst, pContext->pSrc, pContext->ddwSize);
+	else
+		pContext->ddwCount = BitmapPopCount(pContext->pDst, pContext->ddwSize);
+	return NULL;
+}
+
 template<typename KeyT, typename HeadT = void>
 class Bitmap
 {
@@ -165,7 +354,11 @@ public:
 
 		m_BitmapBuffer[pos] |= 0x1 << offset;
 
-        if(!op) ++m_BitmapMetaInfo->ddwUsed;
+		if(!op)
+		{
+			++m_BitmapMetaInfo->ddwUsed;
+			m_RankDirty = true;
+		}
 		return op?true:false;
 	}
 
@@ -181,7 +374,11 @@ public:
 
 		m_BitmapBuffer[pos] &= ~(0x1 << offset);
 
-        if(op) --m_BitmapMetaInfo->ddwUsed;
+		if(op)
+		{
+			--m_BitmapMetaInfo->ddwUsed;
+			m_RankDirty = true;
+		}
 		return op?true:false;
 	}
 
@@ -205,6 +402,214 @@ public:
         return (float)m_BitmapMetaInfo->ddwUsed / m_BitmapMetaInfo->ddwSeed;
     }
 
+	inline uint64_t GetBitCount()
+	{
+		if(m_BitmapMetaInfo == NULL)
+			return 0;
+		return m_BitmapMetaInfo->ddwSeed;
+	}
+
+	// set operations with a bitmap of the same bit count, in place, split
+	// over threads threads; the used count comes out of the same pass
+	inline bool And(Bitmap<KeyT, HeadT>& bitmap, uint32_t threads = 1)
+	{
+		return Combine<BitmapAnd>(&bitmap, threads);
+	}
+
+	inline bool Or(Bitmap<KeyT, HeadT>& bitmap, uint32_t threads = 1)
+	{
+		return Combine<BitmapOr>(&bitmap, threads);
+	}
+
+	inline bool Xor(Bitmap<KeyT, HeadT>& bitmap, uint32_t threads = 1)
+	{
+		return Combine<BitmapXor>(&bitmap, threads);
+	}
+
+	inline bool AndNot(Bitmap<KeyT, HeadT>& bitmap, uint32_t threads = 1)
+	{
+		return Combine<BitmapAndNot>(&bitmap, threads);
+	}
+
+	// bits set, counted over the buffer (and stored as the used count).
+	// Also marks an attached rank directory stale, so after writing
+	// GetBuffer() directly a PopCount() brings both up to date.
+	uint64_t PopCount(uint32_t threads = 1)
+	{
+		if(!Combine<BitmapAnd>(NULL, threads))
+			return 0;
+		return m_BitmapMetaInfo->ddwUsed;
+	}
+
+	// every bit set here is set in bitmap too
+	bool IsSubset(Bitmap<KeyT, HeadT>& bitmap)
+	{
+		if(!Success() || !bitmap.Success() || GetBitCount() != bitmap.GetBitCount())
+			return false;
+
+		size_t size = GetByteSize();
+		size_t i = 0;
+		for(; i+8<=size; i+=8)
+		{
+			if(BitmapAndNot::Apply(BitmapLoadWord(m_BitmapBuffer + i), BitmapLoadWord(bitmap.m_BitmapBuffer + i)) != 0)
+				return false;
+		}
+		for(; i<size; ++i)
+		{
+			if(m_BitmapBuffer[i] & ~bitmap.m_BitmapBuffer[i])
+				return false;
+		}
+		return true;
+	}
+
+	// first set bit at or after pos, BITMAP_NPOS when there is none
+	uint64_t NextSetBit(uint64_t pos)
+	{
+		if(!Success() || pos >= m_BitmapMetaInfo->ddwSeed)
+			return BITMAP_NPOS;
+
+		size_t wordCount = GetWordCount();
+		size_t index = pos / 64;
+		uint64_t word = GetWord(index) & (~0ULL << (pos % 64));
+		while(word == 0)
+		{
+			if(++index == wordCount)
+				return BITMAP_NPOS;
+			word = GetWord(index);
+		}
+
+		pos = index * 64 + __builtin_ctzll(word);
+		return (pos < m_BitmapMetaInfo->ddwSeed)?pos:BITMAP_NPOS;
+	}
+
+	// calls callback(pos) for every set bit, in order
+	template<typename CallbackT>
+	void ForEach(CallbackT callback)
+	{
+		if(!Success())
+			return;
+
+		size_t wordCount = GetWordCount();
+		for(size_t index=0; index<wordCount; ++index)
+		{
+			for(uint64_t word = GetWord(index); word; word &= word - 1)
+				callback((uint64_t)index * 64 + __builtin_ctzll(word));
+		}
+	}
+
+	static inline size_t GetRankSize(size_t bitCount)
+	{
+		size_t blockCount = (bitCount + 511) / 512;
+		return sizeof(uint64_t) + blockCount * sizeof(BitmapRankBlock) +
+				(bitCount / BITMAP_SELECT_SAMPLE + 1) * sizeof(uint64_t);
+	}
+
+	// rank/select directory of the bitmap, kept in buffer (after the bitmap
+	// in the same storage, say), built here with a pass over the bits. A
+	// change made through this object marks it stale and the next Rank() or
+	// Select() rebuilds it; after changes made elsewhere call BuildRank().
+	bool AttachRank(char* buffer, size_t size)
+	{
+		if(!Success() || !buffer || size < GetRankSize(m_BitmapMetaInfo->ddwSeed))
+			return false;
+
+		m_RankBuffer = buffer;
+		BuildRank();
+		return true;
+	}
+
+	inline void DetachRank()
+	{
+		m_RankBuffer = NULL;
+	}
+
+	void BuildRank()
+	{
+		if(!Success() || !m_RankBuffer)
+			return;
+
+		BitmapRankBlock* pBlock = GetRankBlock();
+		uint64_t* pSample = GetSelectSample();
+
+		size_t wordCount = GetWordCount();
+		size_t blockCount = (wordCount + 7) / 8;
+		uint64_t rank = 0;
+		for(size_t block=0; block<blockCount; ++block)
+		{
+			pBlock[block].ddwRank = rank;
+
+			uint64_t relative = 0;
+			uint64_t count = 0;
+			for(size_t i=0; i<8 && block * 8 + i<wordCount; ++i)
+			{
+				if(i)
+					relative |= count << ((i - 1) * 9);
+				count += __builtin_popcountll(GetWord(block * 8 + i));
+			}
+			// words past the end get the full count, so no word search stops there
+			for(size_t i=wordCount-block*8; i<8; ++i)
+				relative |= count << ((i - 1) * 9);
+			pBlock[block].ddwRelative = relative;
+
+			for(uint64_t k=(rank + BITMAP_SELECT_SAMPLE - 1) / BITMAP_SELECT_SAMPLE * BITMAP_SELECT_SAMPLE;
+				k<rank+count; k+=BITMAP_SELECT_SAMPLE)
+				pSample[k / BITMAP_SELECT_SAMPLE] = block;
+			rank += count;
+		}
+		memcpy(m_RankBuffer, &rank, sizeof(uint64_t));
+		m_RankDirty = false;
+	}
+
+	// set bits before pos
+	uint64_t Rank(uint64_t pos)
+	{
+		if(!PrepareRank())
+			return 0;
+		if(pos >= m_BitmapMetaInfo->ddwSeed)
+			return GetRankCount();
+
+		BitmapRankBlock* pBlock = &GetRankBlock()[pos / 512];
+		uint32_t word = pos / 64 % 8;
+		uint64_t rank = pBlock->ddwRank;
+		if(word)
+			rank += (pBlock->ddwRelative >> ((word - 1) * 9)) & 0x1FF;
+		return rank + __builtin_popcountll(GetWord(pos / 64) & ((1ULL << (pos % 64)) - 1));
+	}
+
+	// position of set bit k (from 0), BITMAP_NPOS past the last one. Not
+	// constant time: O(log gap) with gap the blocks between the samples
+	// around k, which in a sparse span is up to the whole bitmap
+	uint64_t Select(uint64_t k)
+	{
+		if(!PrepareRank() || k >= GetRankCount())
+			return BITMAP_NPOS;
+
+		BitmapRankBlock* pBlock = GetRankBlock();
+		uint64_t* pSample = GetSelectSample();
+
+		// last block starting at or before set bit k
+		uint64_t sample = k / BITMAP_SELECT_SAMPLE;
+		uint64_t begin = pSample[sample];
+		uint64_t end = (sample + 1 < (GetRankCount() + BITMAP_SELECT_SAMPLE - 1) / BITMAP_SELECT_SAMPLE)?
+							pSample[sample + 1] + 1:(GetWordCount() + 7) / 8;
+		while(end - begin > 1)
+		{
+			uint64_t middle = (begin + end) / 2;
+			if(pBlock[middle].ddwRank <= k)
+				begin = middle;
+			else
+				end = middle;
+		}
+
+		uint64_t rest = k - pBlock[begin].ddwRank;
+		uint32_t word = 0;
+		while(word < 7 && ((pBlock[begin].ddwRelative >> (word * 9)) & 0x1FF) <= rest)
+			++word;
+		if(word)
+			rest -= (pBlock[begin].ddwRelative >> ((word - 1) * 9)) & 0x1FF;
+		return (begin * 8 + word) * 64 + BitmapSelectWord(GetWord(begin * 8 + word), rest);
+	}
+
 	void Dump()
 	{
 		HexDump((char*)m_BitmapMetaInfo, m_BitmapMetaInfo->ddwMemSize, NULL);
@@ -213,15 +618,381 @@ public:
 	Bitmap() :
 		m_NeedDelete(false),
 		m_BitmapMetaInfo(NULL),
-		m_BitmapBuffer(NULL)
+		m_BitmapBuffer(NULL),
+		m_RankBuffer(NULL),
+		m_RankDirty(false)
 	{
 	}
 
 protected:
+	inline size_t GetByteSize()
+	{
+		return (m_BitmapMetaInfo->ddwSeed + 7) / 8;
+	}
+
+	inline size_t GetWordCount()
+	{
+		return (m_BitmapMetaInfo->ddwSeed + 63) / 64;
+	}
+
+	// word index of the bits, the last one only up to the end of the buffer
+	inline uint64_t GetWord(size_t index)
+	{
+		size_t size = GetByteSize();
+		if(index * 8 + 8 <= size)
+			return BitmapLoadWord(m_BitmapBuffer + index * 8);
+
+		uint64_t word = 0;
+		memcpy(&word, m_BitmapBuffer + index * 8, size - index * 8);
+		return word;
+	}
+
+	inline BitmapRankBlock* GetRankBlock()
+	{
+		return (BitmapRankBlock*)(m_RankBuffer + sizeof(uint64_t));
+	}
+
+	inline uint64_t* GetSelectSample()
+	{
+		return (uint64_t*)(m_RankBuffer + sizeof(uint64_t) + (GetWordCount() + 7) / 8 * sizeof(BitmapRankBlock));
+	}
+
+	inline uint64_t GetRankCount()
+	{
+		uint64_t count;
+		memcpy(&count, m_RankBuffer, sizeof(uint64_t));
+		return count;
+	}
+
+	inline bool PrepareRank()
+	{
+		if(!Success() || !m_RankBuffer)
+			return false;
+		if(m_RankDirty)
+			BuildRank();
+		return true;
+	}
+
+	// pBitmap NULL only counts
+	template<typename OpT>
+	bool Combine(Bitmap<KeyT, HeadT>* pBitmap, uint32_t threads)
+	{
+		if(!Success() || (pBitmap && (!pBitmap->Success() || GetBitCount() != pBitmap->GetBitCount())))
+			return false;
+
+		size_t size = GetByteSize();
+		if(threads == 0)
+			threads = 1;
+
+		// ranges on 32 byte boundaries, so every thread runs whole words
+		std::vector<BitmapCombineContext> vContext(threads);
+		std::vector<pthread_t> vThread(threads);
+		std::vector<bool> vStarted(threads, false);
+		for(uint32_t i=0; i<threads; ++i)
+		{
+			size_t begin = (size / threads * i) & ~(size_t)31;
+			size_t end = (i + 1 == threads)?size:((size / threads * (i + 1)) & ~(size_t)31);
+
+			vContext[i].pDst = m_BitmapBuffer + begin;
+			vContext[i].pSrc = pBitmap?pBitmap->m_BitmapBuffer + begin:NULL;
+			vContext[i].ddwSize = end - begin;
+			vContext[i].ddwCount = 0;
+
+			if(i + 1 < threads && pthread_create(&vThread[i], NULL, BitmapCombineThread<OpT>, &vContext[i]) == 0)
+				vStarted[i] = true;
+			else
+				BitmapCombineThread<OpT>(&vContext[i]);
+		}
+
+		uint64_t used = 0;
+		for(uint32_t i=0; i<threads; ++i)
+		{
+			if(vStarted[i])
+				pthread_join(vThread[i], NULL);
+			used += vContext[i].ddwCount;
+		}
+		m_BitmapMetaInfo->ddwUsed = used;
+		m_RankDirty = true;
+		return true;
+	}
+
 	bool m_NeedDelete;
 
     BitmapMeta<HeadT>* m_BitmapMetaInfo;
 	char* m_BitmapBuffer;
+
+	char* m_RankBuffer;
+	bool m_RankDirty;
+};
+
+struct BitmapCounter
+{
+	uint64_t ddwCount;
+	char cPadding[56];
+};
+
+// counter slot of the calling thread. The threads of forked processes have
+// the same pthread_self() values, so the pid goes into the hash too; it is
+// computed once per thread and again in the child after a fork, not with a
+// getpid() call per update. A template only so the header can define the
+// statics.
+template<int N = 0>
+struct BitmapCounterSlot
+{
+	static inline uint32_t Get()
+	{
+		if(s_Slot < 0)
+		{
+			pthread_once(&s_Once, Register);
+			s_Slot = MixRowKey((uint64_t)pthread_self() ^ ((uint64_t)getpid() << 32), 0) % BITMAP_COUNTER_SLOTS;
+		}
+		return s_Slot;
+	}
+
+private:
+	static void Reset()
+	{
+		s_Slot = -1;
+	}
+
+	static void Register()
+	{
+		pthread_atfork(NULL, NULL, Reset);
+	}
+
+	static __thread int32_t s_Slot;
+	static pthread_once_t s_Once;
+};
+template<int N> __thread int32_t BitmapCounterSlot<N>::s_Slot = -1;
+template<int N> pthread_once_t BitmapCounterSlot<N>::s_Once = PTHREAD_ONCE_INIT;
+
+// Bitmap whose Set() and Unset() are safe to call from any number of
+// threads, and processes sharing a SharedMemoryStorage or MapStorage: a bit
+// is changed by an atomic fetch-or or fetch-and on its 64 bit word, and the
+// used count is kept in BITMAP_COUNTER_SLOTS counters after the bits so
+// writers do not fight over one cache line. The counters are summed when
+// the used count is read.
+//
+// The buffer is a Bitmap buffer with the counters appended (dwReserved[0]
+// holds their number), a Bitmap can read it. The bulk operations and
+// PopCount() fold the counters back into ddwUsed and must not run next to
+// writers. Set() and Unset() leave an attached rank directory as it is:
+// call BuildRank() once the writers are done.
+template<typename KeyT, typename HeadT = void>
+class AtomicBitmap :
+	public Bitmap<KeyT, HeadT>
+{
+public:
+	typedef Bitmap<KeyT, HeadT> BitmapType;
+
+	static AtomicBitmap<KeyT, HeadT> CreateBitmap(size_t bitCount)
+	{
+		AtomicBitmap<KeyT, HeadT> bitmap;
+
+		size_t size = GetBufferSize(bitCount);
+		char* buffer = (char*)malloc(size);
+		if(buffer == NULL)
+			return bitmap;
+
+		memset(buffer, 0, size);
+		if(!bitmap.Initialize(buffer, size, bitCount))
+		{
+			free(buffer);
+			return bitmap;
+		}
+		bitmap.m_NeedDelete = true;
+		return bitmap;
+	}
+
+	static AtomicBitmap<KeyT, HeadT> LoadBitmap(char* buffer, size_t size)
+	{
+		AtomicBitmap<KeyT, HeadT> bitmap;
+		if(!buffer || size <= sizeof(BitmapMeta<HeadT>) + BITMAP_COUNTER_SLOTS * sizeof(BitmapCounter))
+			return bitmap;
+
+		// a new buffer takes as many bits as fit before the counters
+		size_t bitCount = ((size - BITMAP_COUNTER_SLOTS * sizeof(BitmapCounter)) & ~(size_t)63);
+		bitCount = (bitCount > sizeof(BitmapMeta<HeadT>))?(bitCount - sizeof(BitmapMeta<HeadT>)) * 8:0;
+		bitmap.Initialize(buffer, size, bitCount);
+		return bitmap;
+	}
+
+	template<typename StorageT>
+	static AtomicBitmap<KeyT, HeadT> LoadBitmap(StorageT storage)
+	{
+		return AtomicBitmap<KeyT, HeadT>::LoadBitmap(storage.GetStorageBuffer(), storage.GetSize());
+	}
+
+	static size_t GetBufferSize(size_t bitCount)
+	{
+		return GetCounterOffset(bitCount) + BITMAP_COUNTER_SLOTS * sizeof(BitmapCounter);
+	}
+
+	bool Set(KeyT key)
+	{
+		if(!this->Success())
+			return false;
+
+		size_t hash = KeyTranslate<KeyT>::Translate(key) % this->m_BitmapMetaInfo->ddwSeed;
+		bool op = Update(hash, true);
+		if(!op)
+			AtomicFetchAdd(&GetCounter()->ddwCount, (uint64_t)1);
+		return op;
+	}
+
+	bool Unset(KeyT key)
+	{
+		if(!this->Success())
+			return false;
+
+		size_t hash = KeyTranslate<KeyT>::Translate(key) % this->m_BitmapMetaInfo->ddwSeed;
+		bool op = Update(hash, false);
+		if(op)
+			AtomicFetchAdd(&GetCounter()->ddwCount, (uint64_t)-1);
+		return op;
+	}
+
+	bool Contains(KeyT key)
+	{
+		if(!this->Success())
+			return false;
+
+		size_t hash = KeyTranslate<KeyT>::Translate(key) % this->m_BitmapMetaInfo->ddwSeed;
+		return (AtomicLoad(&this->m_BitmapBuffer[hash / 8]) & (0x1 << (hash % 8)))?true:false;
+	}
+
+	// ddwUsed plus what the counters added since it was last counted
+	uint64_t GetUsed()
+	{
+		if(!this->Success())
+			return 0;
+
+		// only the bulk operations write ddwUsed, never next to writers
+		uint64_t used = this->m_BitmapMetaInfo->ddwUsed;
+		for(uint32_t i=0; i<BITMAP_COUNTER_SLOTS; ++i)
+			used += AtomicLoad(&m_Counter[i].ddwCount);
+		return used;
+	}
+
+	float Capacity()
+	{
+		if(!this->Success())
+			return 1;
+		return (float)GetUsed() / this->m_BitmapMetaInfo->ddwSeed;
+	}
+
+	inline bool And(BitmapType& bitmap, uint32_t threads = 1)
+	{
+		return Fold(BitmapType::And(bitmap, threads));
+	}
+
+	inline bool Or(BitmapType& bitmap, uint32_t threads = 1)
+	{
+		return Fold(BitmapType::Or(bitmap, threads));
+	}
+
+	inline bool Xor(BitmapType& bitmap, uint32_t threads = 1)
+	{
+		return Fold(BitmapType::Xor(bitmap, threads));
+	}
+
+	inline bool AndNot(BitmapType& bitmap, uint32_t threads = 1)
+	{
+		return Fold(BitmapType::AndNot(bitmap, threads));
+	}
+
+	uint64_t PopCount(uint32_t threads = 1)
+	{
+		uint64_t used = BitmapType::PopCount(threads);
+		Fold(this->Success());
+		return used;
+	}
+
+	AtomicBitmap() :
+		m_Counter(NULL)
+	{
+	}
+
+protected:
+	static inline size_t GetCounterOffset(size_t bitCount)
+	{
+		return (sizeof(BitmapMeta<HeadT>) + (bitCount + 7) / 8 + 63) & ~(size_t)63;
+	}
+
+	bool Initialize(char* buffer, size_t size, size_t bitCount)
+	{
+		BitmapMeta<HeadT>* pMeta = (BitmapMeta<HeadT>*)buffer;
+		if(memcmp(pMeta->cMagic, "\0\0\0\0\0\0\0\0", 8) == 0)
+		{
+			if(bitCount == 0 || GetBufferSize(bitCount) > size)
+				return false;
+
+			memcpy(pMeta->cMagic, BITMAP_MAGIC, 8);
+			pMeta->wVersion = BITMAP_VERSION;
+
+			pMeta->ddwMemSize = size;
+			pMeta->dwHeadSize = sizeof(BitmapMeta<HeadT>);
+
+			pMeta->ddwSeed = bitCount;
+			pMeta->ddwUsed = 0;
+			pMeta->dwReserved[0] = BITMAP_COUNTER_SLOTS;
+		}
+		else if(memcmp(pMeta->cMagic, BITMAP_MAGIC, 8) != 0 ||
+				pMeta->wVersion != BITMAP_VERSION ||
+				pMeta->ddwMemSize != size ||
+				pMeta->dwHeadSize != sizeof(BitmapMeta<HeadT>) ||
+				pMeta->dwReserved[0] != BITMAP_COUNTER_SLOTS ||
+				pMeta->ddwSeed == 0 ||
+				GetBufferSize(pMeta->ddwSeed) > size)
+			return false;
+
+		this->m_BitmapMetaInfo = pMeta;
+		this->m_BitmapBuffer = buffer + sizeof(BitmapMeta<HeadT>);
+		m_Counter = (BitmapCounter*)(buffer + GetCounterOffset(pMeta->ddwSeed));
+		return true;
+	}
+
+	inline BitmapCounter* GetCounter()
+	{
+		return &m_Counter[BitmapCounterSlot<>::Get()];
+	}
+
+	// sets or clears bit hash, returns whether it was set. The aligned 64
+	// bit word around the bit never leaves the buffer (the header is before
+	// the bits and the counters after them), other bits of it are left as
+	// they are by the fetch-or/fetch-and; an unaligned buffer falls back to
+	// bytes.
+	bool Update(size_t hash, bool bSet)
+	{
+		char* pByte = &this->m_BitmapBuffer[hash / 8];
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if(((uintptr_t)this->m_BitmapMetaInfo & 7) == 0)
+		{
+			uint64_t* pWord = (uint64_t*)((uintptr_t)pByte & ~(uintptr_t)7);
+			uint64_t mask = (uint64_t)1 << ((pByte - (char*)pWord) * 8 + hash % 8);
+			if(bSet)
+				return (AtomicFetchOr(pWord, mask) & mask)?true:false;
+			return (AtomicFetchAnd(pWord, ~mask) & mask)?true:false;
+		}
+#endif
+		char mask = 0x1 << (hash % 8);
+		if(bSet)
+			return (AtomicFetchOr(pByte, mask) & mask)?true:false;
+		return (AtomicFetchAnd(pByte, (char)~mask) & mask)?true:false;
+	}
+
+	// after a bulk operation ddwUsed is the count, the counters start over
+	bool Fold(bool bSuccess)
+	{
+		if(bSuccess)
+		{
+			for(uint32_t i=0; i<BITMAP_COUNTER_SLOTS; ++i)
+				m_Counter[i].ddwCount = 0;
+		}
+		return bSuccess;
+	}
+
+	BitmapCounter* m_Counter;
 };
 
 #endif // define __BITMAP_HPP__
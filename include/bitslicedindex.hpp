@@ -0,0 +1,364 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.05.19
+ *
+*--*/
+#ifndef __BITSLICEDINDEX_HPP__
+#define __BITSLICEDINDEX_HPP__
+
+#include <utility>
+#include <string>
+#include <vector>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "bitmap.hpp"
+
+#define BITSLICEDINDEX_MAGIC	"BITSLICE"
+#define BITSLICEDINDEX_VERSION	0x0101
+
+template<typename HeadT>
+struct BitSlicedIndexMeta {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint64_t ddwMemSize;
+    uint32_t dwHeadSize;
+
+    uint64_t ddwCount;
+    uint32_t dwBits;
+
+    uint32_t dwReserved[4];
+
+    HeadT Head;
+} __attribute__((packed));
+template<>
+struct BitSlicedIndexMeta<void> {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint64_t ddwMemSize;
+    uint32_t dwHeadSize;
+
+    uint64_t ddwCount;
+    uint32_t dwBits;
+
+    uint32_t dwReserved[4];
+} __attribute__((packed));
+
+// numeric attribute of ids 0 to count - 1 (count rounded up to a multiple
+// of 8) kept as bits Bitmap slices, slice i holding bit i of the value of
+// every id, plus a Bitmap of the ids that have a value. A range predicate
+// walks the slices from the top bit down once per 64 ids, narrowing the
+// ids still equal to the bound and moving the others to below or above
+// it, so its cost is bits word operations per 64 ids whatever the range.
+// The result is a Bitmap of count bits, ready to And() with other filters
+// (its rank directory, if any, is marked stale).
+//
+// The buffer is the meta followed by the Bitmap buffers of the ids with a
+// value and of every slice.
+template<typename HeadT = void>
+class BitSlicedIndex
+{
+public:
+	typedef Bitmap<uint64_t> BitmapType;
+
+	static BitSlicedIndex<HeadT> CreateIndex(uint64_t count, uint32_t bits)
+	{
+		BitSlicedIndex<HeadT> index;
+
+		size_t size = GetBufferSize(count, bits);
+		char* buffer = (char*)malloc(size);
+		if(!buffer)
+			return index;
+
+		memset(buffer, 0, size);
+		if(!index.Initialize(buffer, size, count, bits))
+		{
+			free(buffer);
+			return index;
+		}
+		index.m_NeedDelete = true;
+		return index;
+	}
+
+	static BitSlicedIndex<HeadT> LoadIndex(char* buffer, size_t size, uint64_t count, uint32_t bits)
+	{
+		BitSlicedIndex<HeadT> index;
+		index.Initialize(buffer, size, count, bits);
+		return index;
+	}
+
+	template<typename StorageT>
+	static BitSlicedIndex<HeadT> LoadIndex(StorageT storage, uint64_t count, uint32_t bits)
+	{
+		return BitSlicedIndex<HeadT>::LoadIndex(storage.GetStorageBuffer(), storage.GetSize(), count, bits);
+	}
+
+	static inline size_t GetBufferSize(uint64_t count, uint32_t bits)
+	{
+		return sizeof(BitSlicedIndexMeta<HeadT>) + BitmapType::GetBufferSize(count) * (bits + 1);
+	}
+
+	inline bool Success()
+	{
+		return m_MetaInfo != NULL;
+	}
+
+	HeadT* GetHead()
+	{
+		if(m_MetaInfo == NULL)
+			return NULL;
+		return &m_MetaInfo->Head;
+	}
+
+	inline uint64_t GetCount()
+	{
+		return m_MetaInfo?m_MetaInfo->ddwCount:0;
+	}
+
+	inline uint32_t GetBits()
+	{
+		return m_MetaInfo?m_MetaInfo->dwBits:0;
+	}
+
+	// ids with a value
+	inline BitmapType& GetExistence()
+	{
+		return m_Existence;
+	}
+
+	inline BitmapType& GetSlice(uint32_t bit)
+	{
+		return m_Slices[bit];
+	}
+
+	bool Set(uint64_t id, uint64_t value)
+	{
+		if(!m_MetaInfo || id >= m_MetaInfo->ddwCount || value > GetMaxValue())
+			return false;
+
+		for(uint32_t i=0; i<m_MetaInfo->dwBits; ++i)
+		{
+			if((value >> i) & 1)
+				m_Slices[i].Set(id);
+			else
+				m_Slices[i].Unset(id);
+		}
+		m_Existence.Set(id);
+		return true;
+	}
+
+	bool Get(uint64_t id, uint64_t* pValue)
+	{
+		if(!m_MetaInfo || id >= m_MetaInfo->ddwCount || !m_Existence.Contains(id))
+			return false;
+
+		uint64_t value = 0;
+		for(uint32_t i=0; i<m_MetaInfo->dwBits; ++i)
+		{
+			if(m_Slices[i].Contains(id))
+				value |= 1ULL << i;
+		}
+		if(pValue)
+			*pValue = value;
+		return true;
+	}
+
+	void Clear(uint64_t id)
+	{
+		if(!m_MetaInfo || id >= m_MetaInfo->ddwCount)
+			return;
+
+		for(uint32_t i=0; i<m_MetaInfo->dwBits; ++i)
+			m_Slices[i].Unset(id);
+		m_Existence.Unset(id);
+	}
+
+	// ids whose value is in [low, high], into result, a Bitmap of GetCount()
+	// bits whose old bits are overwritten
+	bool Between(uint64_t low, uint64_t high, BitmapType& result)
+	{
+		if(!m_MetaInfo || !result.Success() || result.GetBitCount() != m_MetaInfo->ddwCount)
+			return false;
+
+		if(low > high || low > GetMaxValue())
+		{
+			memset(result.GetBuffer(), 0, GetByteSize());
+			result.PopCount();
+			return true;
+		}
+		if(high > GetMaxValue())
+			high = GetMaxValue();
+
+		std::vector<const char*> vSlice(m_MetaInfo->dwBits);
+		for(uint32_t i=0; i<m_MetaInfo->dwBits; ++i)
+			vSlice[i] = m_Slices[i].GetBuffer();
+		const char* pExistence = m_Existence.GetBuffer();
+		char* pResult = result.GetBuffer();
+
+		size_t size = GetByteSize();
+		for(size_t offset=0; offset<size; offset+=8)
+		{
+			uint64_t exist = LoadWord(pExistence, offset, size);
+
+			// ids equal to the bound so far, and ids already past it
+			uint64_t lowEqual = exist;
+			uint64_t highEqual = exist;
+			uint64_t above = 0;
+			uint64_t below = 0;
+			for(uint32_t i=m_MetaInfo->dwBits; i-- > 0; )
+			{
+				if(!(lowEqual | highEqual))
+					break;
+
+				uint64_t slice = LoadWord(vSlice[i], offset, size);
+				if((low >> i) & 1)
+					lowEqual &= slice;
+				else
+				{
+					above |= lowEqual & slice;
+					lowEqual &= ~slice;
+				}
+
+				if((high >> i) & 1)
+				{
+					below |= highEqual & ~slice;
+					highEqual &= slice;
+				}
+				else
+					highEqual &= ~slice;
+			}
+			StoreWord(pResult, offset, size, (above | lowEqual) & (below | highEqual));
+		}
+		result.PopCount();
+		return true;
+	}
+
+	inline bool Equal(uint64_t value, BitmapType& result)
+	{
+		return Between(value, value, result);
+	}
+
+	inline bool LessThan(uint64_t value, BitmapType& result)
+	{
+		if(value == 0)
+			return Between(1, 0, result);
+		return Between(0, value - 1, result);
+	}
+
+	inline bool GreaterThan(uint64_t value, BitmapType& result)
+	{
+		if(value >= GetMaxValue())
+			return Between(1, 0, result);
+		return Between(value + 1, GetMaxValue(), result);
+	}
+
+	inline bool LessEqual(uint64_t value, BitmapType& result)
+	{
+		return Between(0, value, result);
+	}
+
+	inline bool GreaterEqual(uint64_t value, BitmapType& result)
+	{
+		return Between(value, GetMaxValue(), result);
+	}
+
+	void Delete()
+	{
+		if(m_NeedDelete && m_MetaInfo)
+			free(m_MetaInfo);
+		m_MetaInfo = NULL;
+		m_Slices.clear();
+	}
+
+	BitSlicedIndex() :
+		m_NeedDelete(false),
+		m_MetaInfo(NULL)
+	{
+	}
+
+protected:
+	bool Initialize(char* buffer, size_t size, uint64_t count, uint32_t bits)
+	{
+		// a new Bitmap buffer takes every bit of its bytes
+		count = (count + 7) / 8 * 8;
+		if(!buffer || count == 0 || bits == 0 || bits > 64 || size != GetBufferSize(count, bits))
+			return false;
+
+		BitSlicedIndexMeta<HeadT>* pMetaInfo = (BitSlicedIndexMeta<HeadT>*)buffer;
+		if(memcmp(pMetaInfo->cMagic, "\0\0\0\0\0\0\0\0", 8) == 0)
+		{
+			memcpy(pMetaInfo->cMagic, BITSLICEDINDEX_MAGIC, 8);
+			pMetaInfo->wVersion = BITSLICEDINDEX_VERSION;
+
+			pMetaInfo->ddwMemSize = size;
+			pMetaInfo->dwHeadSize = sizeof(BitSlicedIndexMeta<HeadT>);
+
+			pMetaInfo->ddwCount = count;
+			pMetaInfo->dwBits = bits;
+		}
+		else if(memcmp(pMetaInfo->cMagic, BITSLICEDINDEX_MAGIC, 8) != 0 ||
+				pMetaInfo->wVersion != BITSLICEDINDEX_VERSION ||
+				pMetaInfo->ddwMemSize != size ||
+				pMetaInfo->dwHeadSize != sizeof(BitSlicedIndexMeta<HeadT>) ||
+				pMetaInfo->ddwCount != count ||
+				pMetaInfo->dwBits != bits)
+			return false;
+
+		size_t bitmapSize = BitmapType::GetBufferSize(count);
+		char* pBitmap = buffer + sizeof(BitSlicedIndexMeta<HeadT>);
+		std::vector<BitmapType> vSlices(bits);
+		for(uint32_t i=0; i<=bits; ++i, pBitmap+=bitmapSize)
+		{
+			BitmapType bitmap = BitmapType::LoadBitmap(pBitmap, bitmapSize);
+			if(!bitmap.Success() || bitmap.GetBitCount() != count)
+				return false;
+
+			if(i == 0)
+				m_Existence = bitmap;
+			else
+				vSlices[i - 1] = bitmap;
+		}
+
+		m_Slices.swap(vSlices);
+		m_MetaInfo = pMetaInfo;
+		return true;
+	}
+
+	inline uint64_t GetMaxValue()
+	{
+		return (m_MetaInfo->dwBits == 64)?~0ULL:((1ULL << m_MetaInfo->dwBits) - 1);
+	}
+
+	inline size_t GetByteSize()
+	{
+		return (m_MetaInfo->ddwCount + 7) / 8;
+	}
+
+	static inline uint64_t LoadWord(const char* buffer, size_t offset, size_t size)
+	{
+		if(offset + 8 <= size)
+			return BitmapLoadWord(buffer + offset);
+
+		uint64_t word = 0;
+		memcpy(&word, buffer + offset, size - offset);
+		return word;
+	}
+
+	static inline void StoreWord(char* buffer, size_t offset, size_t size, uint64_t word)
+	{
+		memcpy(buffer + offset, &word, (offset + 8 <= size)?8:size - offset);
+	}
+
+	bool m_NeedDelete;
+
+	BitSlicedIndexMeta<HeadT>* m_MetaInfo;
+	BitmapType m_Existence;
+	std::vector<BitmapType> m_Slices;
+};
+
+#endif // define __BITSLICEDINDEX_HPP__
+
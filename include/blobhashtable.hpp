@@ -0,0 +1,382 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.03.24
+ *
+*--*/
+#ifndef __BLOBHASHTABLE_HPP__
+#define __BLOBHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include <vector>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "blocktable.hpp"
+
+template<uint32_t SizeValue>
+struct BlobBlock
+{
+	char Data[SizeValue];
+} __attribute__((packed));
+
+typedef TYPELIST_8(BlobBlock<16>, BlobBlock<32>, BlobBlock<64>, BlobBlock<128>,
+					BlobBlock<256>, BlobBlock<512>, BlobBlock<1024>, BlobBlock<2048>) BlobSizeClassList;
+
+#define BLOB_CLASS_NONE		0xFF
+
+// hashtable slot of a BlobHashTable, the value itself lives in a block of
+// size class cClass in the blob region.
+struct BlobReference
+{
+	uint32_t dwLength;
+	uint32_t dwBlockID;
+	uint8_t cClass;
+} __attribute__((packed));
+
+// runtime size class index -> MultiBlockTable block type
+template<typename TypeListT, uint32_t IndexValue>
+struct BlobClass;
+template<uint32_t IndexValue>
+struct BlobClass<NullType, IndexValue>
+{
+	static inline uint8_t Fit(uint32_t length)
+	{
+		return BLOB_CLASS_NONE;
+	}
+
+	static inline uint32_t Size(uint8_t cls)
+	{
+		return 0;
+	}
+
+	static inline size_t BlockSize(uint8_t cls)
+	{
+		return 0;
+	}
+
+	template<typename BlobTableT>
+	static inline char* Allocate(BlobTableT& table, uint8_t cls, uint32_t* pID)
+	{
+		*pID = 0;
+		return NULL;
+	}
+
+	template<typename BlobTableT>
+	static inline char* Get(BlobTableT& table, uint8_t cls, uint32_t id)
+	{
+		return NULL;
+	}
+
+	template<typename BlobTableT>
+	static inline void Release(BlobTableT& table, uint8_t cls, uint32_t id)
+	{
+	}
+};
+template<typename Type1, typename Type2, uint32_t IndexValue>
+struct BlobClass<TypeList<Type1, Type2>, IndexValue>
+{
+	static inline uint8_t Fit(uint32_t length)
+	{
+		if(length <= sizeof(Type1))
+			return IndexValue;
+		return BlobClass<Type2, IndexValue + 1>::Fit(length);
+	}
+
+	static inline uint32_t Size(uint8_t cls)
+	{
+		if(cls == IndexValue)
+			return sizeof(Type1);
+		return BlobClass<Type2, IndexValue + 1>::Size(cls);
+	}
+
+	static inline size_t BlockSize(uint8_t cls)
+	{
+		if(cls == IndexValue)
+			return sizeof(Block<Type1>);
+		return BlobClass<Type2, IndexValue + 1>::BlockSize(cls);
+	}
+
+	template<typename BlobTableT>
+	static inline char* Allocate(BlobTableT& table, uint8_t cls, uint32_t* pID)
+	{
+		if(cls != IndexValue)
+			return BlobClass<Type2, IndexValue + 1>::Allocate(table, cls, pID);
+
+		Type1* pValue = NULL;
+		*pID = table.AllocateBlock(&pValue);
+		return (char*)pValue;
+	}
+
+	template<typename BlobTableT>
+	static inline char* Get(BlobTableT& table, uint8_t cls, uint32_t id)
+	{
+		if(cls != IndexValue)
+			return BlobClass<Type2, IndexValue + 1>::Get(table, cls, id);
+
+		Type1* pValue = NULL;
+		return (char*)table.GetBlock(id, &pValue);
+	}
+
+	template<typename BlobTableT>
+	static inline void Release(BlobTableT& table, uint8_t cls, uint32_t id)
+	{
+		if(cls != IndexValue)
+			return BlobClass<Type2, IndexValue + 1>::Release(table, cls, id);
+
+		Type1* pValue = NULL;
+		if(table.GetBlock(id, &pValue))
+			table.ReleaseBlock(pValue);
+	}
+};
+
+// HashTable whose values are variable length byte strings. The storage
+// buffer holds a HashTable<KeyT, BlobReference> followed by a MultiBlockTable
+// with one block type per size class; a value is kept in the smallest class
+// that fits it and moves to a larger one when it grows. The blob region gets
+// whatever the buffer has beyond the hashtable, split evenly in bytes between
+// the size classes, so the same (size, seed) always yields the same layout.
+template<typename KeyT, typename HeadT = void, typename SizeClassListT = BlobSizeClassList>
+class BlobHashTable
+{
+public:
+	typedef HashTable<KeyT, BlobReference, HeadT> TableType;
+	typedef MultiBlockTable<SizeClassListT, void> BlobTableType;
+	typedef BlobClass<SizeClassListT, 0> ClassType;
+
+	static BlobHashTable<KeyT, HeadT, SizeClassListT> CreateHashTable(Seed& seed, size_t blobSize)
+	{
+		BlobHashTable<KeyT, HeadT, SizeClassListT> bht;
+
+		size_t bufferSize = GetBufferSize(seed, blobSize);
+		char* buffer = (char*)malloc(bufferSize);
+		if(!buffer)
+			return bht;
+
+		memset(buffer, 0, bufferSize);
+		if(!bht.Initialize(buffer, bufferSize, seed))
+		{
+			free(buffer);
+			return bht;
+		}
+		bht.m_NeedDelete = true;
+		return bht;
+	}
+
+	static BlobHashTable<KeyT, HeadT, SizeClassListT> LoadHashTable(char* buffer, size_t size, Seed& seed)
+	{
+		BlobHashTable<KeyT, HeadT, SizeClassListT> bht;
+		bht.Initialize(buffer, size, seed);
+		return bht;
+	}
+
+	template<typename StorageT>
+	static BlobHashTable<KeyT, HeadT, SizeClassListT> LoadHashTable(StorageT storage, Seed& seed)
+	{
+		BlobHashTable<KeyT, HeadT, SizeClassListT> bht;
+		bht.Initialize(storage.GetStorageBuffer(), storage.GetSize(), seed);
+		return bht;
+	}
+
+	// blobSize is the byte size of the blob region, including its head; it
+	// is split evenly among the size classes, and a blob region too small
+	// for one block of the largest class fails to load
+	static inline size_t GetBufferSize(Seed& seed, size_t blobSize)
+	{
+		return TableType::GetBufferSize(seed) + blobSize;
+	}
+
+	static inline uint32_t GetMaxLength()
+	{
+		return ClassType::Size(TypeListLength<SizeClassListT>::Length - 1);
+	}
+
+	bool Initialize(char* buffer, size_t size, Seed& seed)
+	{
+		size_t tableSize = TableType::GetBufferSize(seed);
+		if(!buffer || size <= tableSize + sizeof(MultiBlockHead<SizeClassListT, void>))
+			return false;
+
+		size_t blobSize = size - tableSize;
+		size_t classSize = (blobSize - sizeof(MultiBlockHead<SizeClassListT, void>)) / TypeListLength<SizeClassListT>::Length;
+
+		// every class gets an equal share, which must hold at least one block
+		std::vector<uint32_t> vSize;
+		for(uint8_t i=0; i<TypeListLength<SizeClassListT>::Length; ++i)
+		{
+			vSize.push_back(classSize / ClassType::BlockSize(i));
+			if(vSize.back() == 0)
+				return false;
+		}
+
+		m_Table = TableType::LoadHashTable(buffer, tableSize, seed);
+		m_BlobTable = BlobTableType::LoadMultiBlockTable(buffer + tableSize, blobSize, vSize);
+		if(!m_Table.Success() || !m_BlobTable.Success())
+		{
+			m_Table = TableType();
+			m_BlobTable = BlobTableType();
+			return false;
+		}
+
+		m_Buffer = buffer;
+		return true;
+	}
+
+	inline bool Success()
+	{
+		return m_Table.Success() && m_BlobTable.Success();
+	}
+
+	// returns the value of key, valid until the next Put/Append/Clear of it
+	char* Get(KeyT key, uint32_t* pLength = NULL)
+	{
+		BlobReference* pReference = m_Table.Hash(key);
+		if(!pReference)
+			return NULL;
+
+		if(pLength)
+			*pLength = pReference->dwLength;
+		return ClassType::Get(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+	}
+
+	bool Put(KeyT key, const char* data, uint32_t length)
+	{
+		uint8_t cls = ClassType::Fit(length);
+		if(cls == BLOB_CLASS_NONE)
+			return false;
+
+		BlobReference* pReference = m_Table.Hash(key, true);
+		if(!pReference)
+			return false;
+
+		char* pData = NULL;
+		if(pReference->dwBlockID != 0 && pReference->cClass >= cls)
+			pData = ClassType::Get(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+		else if(!(pData = Reallocate(pReference, cls, 0)))
+		{
+			if(pReference->dwBlockID == 0)
+				m_Table.Clear(key);
+			return false;
+		}
+
+		memcpy(pData, data, length);
+		pReference->dwLength = length;
+		return true;
+	}
+
+	bool Append(KeyT key, const char* data, uint32_t length)
+	{
+		BlobReference* pReference = m_Table.Hash(key, true);
+		if(!pReference)
+			return false;
+
+		uint8_t cls = ClassType::Fit(pReference->dwLength + length);
+		if(cls == BLOB_CLASS_NONE)
+		{
+			if(pReference->dwBlockID == 0)
+				m_Table.Clear(key);
+			return false;
+		}
+
+		char* pData = NULL;
+		if(pReference->dwBlockID != 0 && pReference->cClass >= cls)
+			pData = ClassType::Get(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+		else if(!(pData = Reallocate(pReference, cls, pReference->dwLength)))
+		{
+			if(pReference->dwBlockID == 0)
+				m_Table.Clear(key);
+			return false;
+		}
+
+		memcpy(pData + pReference->dwLength, data, length);
+		pReference->dwLength += length;
+		return true;
+	}
+
+	void Clear(KeyT key)
+	{
+		BlobReference* pReference = m_Table.Hash(key);
+		if(!pReference)
+			return;
+
+		ClassType::Release(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+		m_Table.Clear(key);
+	}
+
+	char* Next(HashTableIterator* pstIterator, uint32_t* pLength = NULL)
+	{
+		BlobReference* pReference = m_Table.Next(pstIterator);
+		if(!pReference)
+			return NULL;
+
+		if(pLength)
+			*pLength = pReference->dwLength;
+		return ClassType::Get(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+	}
+
+	inline HeadT* GetHead()
+	{
+		return m_Table.GetHead();
+	}
+
+	float Capacity()
+	{
+		return m_Table.Capacity();
+	}
+
+	// fullest size class of the blob region
+	float BlobCapacity()
+	{
+		return m_BlobTable.Capacity();
+	}
+
+	void Delete()
+	{
+		if(m_NeedDelete && m_Buffer)
+			free(m_Buffer);
+
+		m_Buffer = NULL;
+		m_Table = TableType();
+		m_BlobTable = BlobTableType();
+	}
+
+	BlobHashTable() :
+		m_NeedDelete(false),
+		m_Buffer(NULL)
+	{
+	}
+
+protected:
+	// moves the value of pReference into a block of class cls, keeping the
+	// first length bytes
+	char* Reallocate(BlobReference* pReference, uint8_t cls, uint32_t length)
+	{
+		uint32_t id = 0;
+		char* pData = ClassType::Allocate(m_BlobTable, cls, &id);
+		if(!pData)
+			return NULL;
+
+		if(pReference->dwBlockID != 0)
+		{
+			if(length > 0)
+				memcpy(pData, ClassType::Get(m_BlobTable, pReference->cClass, pReference->dwBlockID), length);
+			ClassType::Release(m_BlobTable, pReference->cClass, pReference->dwBlockID);
+		}
+
+		pReference->dwBlockID = id;
+		pReference->cClass = cls;
+		return pData;
+	}
+
+	bool m_NeedDelete;
+	char* m_Buffer;
+
+	TableType m_Table;
+	BlobTableType m_BlobTable;
+};
+
+#endif // define __BLOBHASHTABLE_HPP__
+
@@ -531,6 +531,9 @@ public:
                     }
                 }
             }
+
+			for(size_t i=0; i<TypeListLength<TypeListT>::Length; ++i)
+				mbt.m_Total[i] = vSize.at(i);
 		}
 		return mbt;
 	}
@@ -539,7 +542,7 @@ public:
 	static inline MultiBlockTable<TypeListT, HeadT> LoadMultiBlockTable(StorageT storage, 
                                                                         std::vector<uint32_t> vSize)
 	{
-		return LoadMultiBlockTable(storage.GetBuffer(), storage.GetSize(), vSize);
+		return LoadMultiBlockTable(storage.GetStorageBuffer(), storage.GetSize(), vSize);
 	}
 
 	static size_t GetBufferSize(std::vector<uint32_t> vSize)
@@ -594,7 +597,7 @@ public:
             return NULL;
 
 		*ppBuffer = (Block<Type>*)(m_BlockBuffer + 
-                                   GetBufferOffset<TypeListT, Type, 0>::Offset(1, m_BlockHead->Total));
+                                   GetBufferOffset<TypeListT, Type, 0>::Offset(1, m_Total));
 		*pCount = m_BlockHead->Total[TypeListIndexOf<TypeListT, Type>::Index];
 		return *ppBuffer;
 	}
@@ -618,7 +621,7 @@ public:
 
 		uint32_t newBlockId = m_BlockHead->EmptyIndex[idx];
 		Block<Type>* pBlock = (Block<Type>*)(m_BlockBuffer
-                                + GetBufferOffset<TypeListT, Type, 0>::Offset(newBlockId, m_BlockHead->Total));
+                                + GetBufferOffset<TypeListT, Type, 0>::Offset(newBlockId, m_Total));
 		if(pBlock->Next == 0)
 			++m_BlockHead->EmptyIndex[idx];
 		else
@@ -665,7 +668,7 @@ public:
         if(m_BlockHead == NULL || m_BlockBuffer == NULL || pValue == NULL)
 			return 0;
 
-		return GetBlockNodeID<TypeListT, Type, 0>::ID(m_BlockBuffer, pValue, m_BlockHead->Total);
+		return GetBlockNodeID<TypeListT, Type, 0>::ID(m_BlockBuffer, pValue, m_Total);
 	}
 	
 	template<typename Type>
@@ -682,7 +685,7 @@ public:
 		}
 
 		Block<Type>* pBlock = (Block<Type>*)(m_BlockBuffer
-								+ GetBufferOffset<TypeListT, Type, 0>::Offset(id, m_BlockHead->Total));
+								+ GetBufferOffset<TypeListT, Type, 0>::Offset(id, m_Total));
 		if((pBlock->Flags & BLOCK_FLAG_ACTIVE) != BLOCK_FLAG_ACTIVE)
 		{
 			if(ppValue)
@@ -700,7 +703,7 @@ public:
 		printf("Head Buffer:\n");
 		HexDump((const char*)m_BlockHead, sizeof(MultiBlockHead<TypeListT, HeadT>), NULL);
 
-		DumpTypeBuffer<TypeListT, 0>::Dump(m_BlockBuffer, m_BlockHead->Total);
+		DumpTypeBuffer<TypeListT, 0>::Dump(m_BlockBuffer, m_Total);
 	}
 
 	MultiBlockTable() :
@@ -715,6 +718,9 @@ protected:
 
 	MultiBlockHead<TypeListT, HeadT>* m_BlockHead;
 	char* m_BlockBuffer;
+
+	// aligned copy of m_BlockHead->Total for the offset helpers, the packed head can't hand out a uint32_t*
+	uint32_t m_Total[TypeListLength<TypeListT>::Length];
 };
 
 
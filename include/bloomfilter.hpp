@@ -12,6 +12,9 @@
 #include <utility>
 #include <string>
 #include <time.h>
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
 #include "utility.hpp"
 #include "keyutility.hpp"
 #include "storage.hpp"
@@ -24,6 +27,11 @@
 #define BLOOMFILTER_MAGIC   "BLOOMFIL"
 #define BLOOMFILTER_VERSION 0x0101
 
+#define BLOCKEDBLOOMFILTER_MAGIC	"BLOOMBLK"
+
+// bytes of a block of a BlockedBloomFilter, a cache line
+#define BLOOMFILTER_BLOCK_SIZE		64
+
 struct BloomFilterMeta {
     char cMagic[8];
     uint16_t wVersion;
@@ -181,4 +189,205 @@ protected:
 };
 
 
+// BloomFilter whose k bits of a key all fall in one BLOOMFILTER_BLOCK_SIZE
+// block (Putze et al.), so Add() and Contains() touch a single cache line
+// however large k is: one mix of the key hash picks the block, others give
+// the k positions in it. Contains() tests the whole block against the mask
+// of the key, with AVX2 when built with -mavx2.
+//
+// The buffer is a Bitmap<uint64_t, BloomFilterMeta> buffer like the one of
+// BloomFilter (magic BLOCKEDBLOOMFILTER_MAGIC); the blocks start at the
+// first 64 byte boundary of it, so a page aligned storage gets aligned
+// blocks. For the same size and count it has a somewhat higher false
+// positive rate than BloomFilter.
+template<typename KeyT>
+class BlockedBloomFilter
+{
+public:
+	typedef Bitmap<uint64_t, BloomFilterMeta> BitmapType;
+
+	static BlockedBloomFilter<KeyT> CreateBloomFilter(size_t size, size_t k = BLOOMFILTER_DEFAULT_K)
+	{
+		BlockedBloomFilter<KeyT> bf;
+
+		size_t bufferSize = BitmapType::GetBufferSize(size * 8);
+		void* buffer = NULL;
+		if(posix_memalign(&buffer, BLOOMFILTER_BLOCK_SIZE, bufferSize) != 0)
+			return bf;
+
+		memset(buffer, 0, bufferSize);
+		bf = LoadBloomFilter((char*)buffer, bufferSize, k);
+		if(!bf.Success())
+		{
+			free(buffer);
+			return bf;
+		}
+		bf.m_NeedDelete = true;
+		return bf;
+	}
+
+	static BlockedBloomFilter<KeyT> LoadBloomFilter(char* buffer, size_t size, size_t k = BLOOMFILTER_DEFAULT_K)
+	{
+		BlockedBloomFilter<KeyT> bf;
+		if(k == 0 || k > BLOOMFILTER_BLOCK_SIZE * 8 || size < sizeof(BitmapMeta<BloomFilterMeta>) + GetBlockOffset() + BLOOMFILTER_BLOCK_SIZE)
+			return bf;
+
+		BitmapType bitmap = BitmapType::LoadBitmap(buffer, size);
+		BloomFilterMeta* pMetaInfo = bitmap.GetHead();
+		if(pMetaInfo == NULL)
+			return bf;
+
+		if(memcmp(pMetaInfo->cMagic, "\0\0\0\0\0\0\0\0", 8) == 0)
+		{
+			memcpy(pMetaInfo->cMagic, BLOCKEDBLOOMFILTER_MAGIC, 8);
+			pMetaInfo->wVersion = BLOOMFILTER_VERSION;
+			pMetaInfo->dwK = k;
+		}
+		else if(memcmp(pMetaInfo->cMagic, BLOCKEDBLOOMFILTER_MAGIC, 8) != 0 ||
+				pMetaInfo->wVersion != BLOOMFILTER_VERSION ||
+				pMetaInfo->dwK != k)
+			return bf;
+
+		uint64_t blockCount = (size - sizeof(BitmapMeta<BloomFilterMeta>) - GetBlockOffset()) / BLOOMFILTER_BLOCK_SIZE;
+		bf.m_Bitmap = bitmap;
+		bf.m_MetaInfo = pMetaInfo;
+		bf.m_BitmapMetaInfo = (BitmapMeta<BloomFilterMeta>*)buffer;
+		bf.m_Blocks = bitmap.GetBuffer() + GetBlockOffset();
+		bf.m_BlockCount = (blockCount < 0xFFFFFFFF)?blockCount:0xFFFFFFFF;
+		if(bf.m_BlockCount > 1)
+			bf.m_BlockModulo.Initialize(bf.m_BlockCount);
+		return bf;
+	}
+
+	template<typename StorageT>
+	static BlockedBloomFilter<KeyT> LoadBloomFilter(StorageT storage, size_t k = BLOOMFILTER_DEFAULT_K)
+	{
+		return BlockedBloomFilter<KeyT>::LoadBloomFilter(storage.GetStorageBuffer(), storage.GetSize(), k);
+	}
+
+	static inline size_t GetBufferSize(size_t count, double pError)
+	{
+		return BloomFilter<KeyT>::GetBufferSize(count, pError) + GetBlockOffset() + BLOOMFILTER_BLOCK_SIZE;
+	}
+
+	static inline size_t GetK(size_t count, double pError)
+	{
+		return BloomFilter<KeyT>::GetK(count, pError);
+	}
+
+	inline bool Success()
+	{
+		return m_MetaInfo != NULL;
+	}
+
+	void Delete()
+	{
+		if(m_NeedDelete && m_BitmapMetaInfo)
+			free(m_BitmapMetaInfo);
+		m_Bitmap = BitmapType();
+		m_MetaInfo = NULL;
+		m_BitmapMetaInfo = NULL;
+		m_Blocks = NULL;
+	}
+
+	void Add(KeyT key)
+	{
+		if(m_MetaInfo == NULL)
+			return;
+
+		uint64_t mask[BLOOMFILTER_BLOCK_SIZE / 8];
+		char* pBlock = GetBlock(KeyTranslate<KeyT>::Translate(key), mask);
+
+		uint64_t used = 0;
+		for(uint32_t i=0; i<BLOOMFILTER_BLOCK_SIZE/8; ++i)
+		{
+			uint64_t word;
+			memcpy(&word, pBlock + i * 8, sizeof(uint64_t));
+			used += __builtin_popcountll(mask[i] & ~word);
+			word |= mask[i];
+			memcpy(pBlock + i * 8, &word, sizeof(uint64_t));
+		}
+		m_BitmapMetaInfo->ddwUsed += used;
+	}
+
+	bool Contains(KeyT key)
+	{
+		if(m_MetaInfo == NULL)
+			return false;
+
+		uint64_t mask[BLOOMFILTER_BLOCK_SIZE / 8];
+		const char* pBlock = GetBlock(KeyTranslate<KeyT>::Translate(key), mask);
+#ifdef __AVX2__
+		return _mm256_testc_si256(_mm256_loadu_si256((const __m256i*)pBlock), _mm256_loadu_si256((const __m256i*)mask)) &&
+				_mm256_testc_si256(_mm256_loadu_si256((const __m256i*)(pBlock + 32)), _mm256_loadu_si256((const __m256i*)(mask + 4)));
+#else
+		for(uint32_t i=0; i<BLOOMFILTER_BLOCK_SIZE/8; ++i)
+		{
+			uint64_t word;
+			memcpy(&word, pBlock + i * 8, sizeof(uint64_t));
+			if((word & mask[i]) != mask[i])
+				return false;
+		}
+		return true;
+#endif
+	}
+
+	float Capacity()
+	{
+		if(m_MetaInfo == NULL)
+			return 1;
+		return (float)m_BitmapMetaInfo->ddwUsed / ((uint64_t)m_BlockCount * BLOOMFILTER_BLOCK_SIZE * 8);
+	}
+
+	void Dump()
+	{
+		m_Bitmap.Dump();
+	}
+
+	BlockedBloomFilter() :
+		m_NeedDelete(false),
+		m_MetaInfo(NULL),
+		m_BitmapMetaInfo(NULL),
+		m_Blocks(NULL),
+		m_BlockCount(0)
+	{
+	}
+
+protected:
+	// bytes from the bitmap buffer to the first block
+	static inline size_t GetBlockOffset()
+	{
+		return (BLOOMFILTER_BLOCK_SIZE - sizeof(BitmapMeta<BloomFilterMeta>) % BLOOMFILTER_BLOCK_SIZE) % BLOOMFILTER_BLOCK_SIZE;
+	}
+
+	// block of hash, and the mask of its k bits in the block, 9 bits each
+	// from a further mix of the hash for every 7 of them
+	inline char* GetBlock(uint64_t hash, uint64_t* pMask)
+	{
+		memset(pMask, 0, BLOOMFILTER_BLOCK_SIZE);
+
+		uint64_t bits = 0;
+		for(uint32_t i=0; i<m_MetaInfo->dwK; ++i, bits>>=9)
+		{
+			if(i % 7 == 0)
+				bits = MixRowKey(hash, i / 7 + 1);
+			uint32_t pos = bits & (BLOOMFILTER_BLOCK_SIZE * 8 - 1);
+			pMask[pos >> 6] |= 1ULL << (pos & 63);
+		}
+
+		uint64_t block = (m_BlockCount > 1)?m_BlockModulo.Mod(MixRowKey(hash, 0)):0;
+		return m_Blocks + block * BLOOMFILTER_BLOCK_SIZE;
+	}
+
+	bool m_NeedDelete;
+
+	BitmapType m_Bitmap;
+	BloomFilterMeta* m_MetaInfo;
+	BitmapMeta<BloomFilterMeta>* m_BitmapMetaInfo;
+
+	char* m_Blocks;
+	uint32_t m_BlockCount;
+	FastModulo m_BlockModulo;
+};
+
 #endif // define __BLOOMFILTER_HPP__
@@ -0,0 +1,349 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.04.21
+ *
+*--*/
+#ifndef __BUCKETHASHTABLE_HPP__
+#define __BUCKETHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define BUCKETHASHTABLE_MAGIC   "BUCKHASH"
+
+// slots of a bucket, one tag byte each, so the tags of a bucket are
+// compared with a single SSE2 instruction
+#define BUCKET_SLOT_COUNT		16
+
+// tag of a slot: empty, or 0x80 | 7 bits of the key hash
+#define BUCKET_TAG_EMPTY		0x00
+#define BUCKET_TAG_FULL			0x80
+
+// overflow count that no longer moves, the bucket stays probed past
+#define BUCKET_OVERFLOW_STICKY	0xFF
+
+template<typename KeyT, typename ValueT, typename HeadT>
+class BucketHashTable;
+
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<BucketHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return BUCKETHASHTABLE_MAGIC;
+    }
+};
+
+// bit i set when tag i of the bucket equals tag
+inline uint32_t BucketMatch(const uint8_t* pTag, uint8_t tag)
+{
+#ifdef __SSE2__
+	__m128i tags = _mm_loadu_si128((const __m128i*)pTag);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+#else
+	uint32_t mask = 0;
+	for(uint32_t i=0; i<BUCKET_SLOT_COUNT; ++i)
+	{
+		if(pTag[i] == tag)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+// bit i set when slot i of the bucket is empty
+inline uint32_t BucketMatchFree(const uint8_t* pTag)
+{
+#ifdef __SSE2__
+	__m128i tags = _mm_loadu_si128((const __m128i*)pTag);
+	return ~_mm_movemask_epi8(tags) & 0xFFFF;
+#else
+	uint32_t mask = 0;
+	for(uint32_t i=0; i<BUCKET_SLOT_COUNT; ++i)
+	{
+		if(!(pTag[i] & BUCKET_TAG_FULL))
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+// HashTable with the same interface (a typedef away) that keeps its nodes
+// in buckets of BUCKET_SLOT_COUNT slots instead of one node per row. A probe
+// compares the 16 tags of a bucket at once and only reads the nodes whose
+// tag matches. A miss usually costs one tag cache line instead of one node
+// per row.
+//
+// The layout is split: the nodes stay where AbstractHashTable puts them,
+// the tags follow as an array of 16 bytes per bucket, then one overflow
+// byte per bucket. A hit reads two cache lines, the tags of its bucket and
+// then its node, but the nodes keep the layout the iterators and the
+// other tables share.
+//
+// The overflow byte of a bucket counts the keys stored past it because it
+// was full when they came in; a probe moves to the next bucket only while
+// that count is not 0. Clear() gives the slot back as empty and takes the
+// key off the counts of the buckets it passed, so churn at a constant load
+// does not leave tombstones that lengthen the probes. A count that reaches
+// BUCKET_OVERFLOW_STICKY stays there.
+//
+// The Seed only gives the node count, rounded down to whole buckets.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class BucketHashTable :
+	public AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, BucketHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, BucketHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+	typedef HashNode<KeyT, ValueT, HashNodeHead<KeyT> > NodeType;
+
+	static BucketHashTable<KeyT, ValueT, HeadT> CreateHashTable(Seed& seed)
+	{
+		BucketHashTable<KeyT, ValueT, HeadT> ht;
+
+		size_t bufferSize = GetBufferSize(seed);
+		char* buffer = (char*)malloc(bufferSize);
+		if(!buffer)
+			return ht;
+
+		memset(buffer, 0, bufferSize);
+		if(!ht.Initialize(buffer, bufferSize, seed))
+		{
+			free(buffer);
+			return ht;
+		}
+		ht.m_NeedDelete = true;
+		return ht;
+	}
+
+	static BucketHashTable<KeyT, ValueT, HeadT> LoadHashTable(char* buffer, size_t size, Seed& seed)
+	{
+		BucketHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(buffer, size, seed);
+		return ht;
+	}
+
+	template<typename StorageT>
+	static BucketHashTable<KeyT, ValueT, HeadT> LoadHashTable(StorageT storage, Seed& seed)
+	{
+		BucketHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(storage.GetStorageBuffer(), storage.GetSize(), seed);
+		return ht;
+	}
+
+	static inline size_t GetBufferSize(Seed& seed)
+	{
+		size_t bucketCount = seed.GetCount() / BUCKET_SLOT_COUNT;
+		return AbstractType::GetBufferSize(seed) + bucketCount * (BUCKET_SLOT_COUNT + 1);
+	}
+
+	bool Initialize(char* buffer, size_t size, Seed& seed)
+	{
+		size_t tableSize = AbstractType::GetBufferSize(seed);
+		if(!buffer || size != GetBufferSize(seed) || seed.GetCount() < BUCKET_SLOT_COUNT)
+			return false;
+
+		if(!AbstractType::Initialize(buffer, tableSize, seed))
+			return false;
+
+		m_Tag = (uint8_t*)(buffer + tableSize);
+		m_BucketCount = this->m_TableMetaInfo->dwTotal / BUCKET_SLOT_COUNT;
+		m_Overflow = m_Tag + m_BucketCount * BUCKET_SLOT_COUNT;
+		if(m_BucketCount > 1)
+			m_BucketModulo.Initialize(m_BucketCount);
+		return true;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		return HashKeyValue(KeyTranslate<KeyT>::Translate(key), bNew);
+	}
+
+	size_t HashMany(typename RemoveReference<KeyT>::Type* keys, size_t count, ValueT** results, bool bNew = false)
+	{
+		if(!keys || !results)
+			return 0;
+
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+		{
+			memset(results, 0, count * sizeof(ValueT*));
+			return 0;
+		}
+
+		typename KeyTranslate<KeyT>::HeadType headKeys[HASHTABLE_PREFETCH_BATCH];
+		size_t found = 0;
+		for(size_t begin=0; begin<count; begin+=HASHTABLE_PREFETCH_BATCH)
+		{
+			size_t batch = count - begin;
+			if(batch > HASHTABLE_PREFETCH_BATCH)
+				batch = HASHTABLE_PREFETCH_BATCH;
+
+			for(size_t i=0; i<batch; ++i)
+			{
+				headKeys[i] = KeyTranslate<KeyT>::Translate(keys[begin + i]);
+				__builtin_prefetch(&m_Tag[Bucket(BucketHash(headKeys[i])) * BUCKET_SLOT_COUNT]);
+			}
+
+			for(size_t i=0; i<batch; ++i)
+			{
+				results[begin + i] = HashKeyValue(headKeys[i], bNew);
+				if(results[begin + i] != NULL)
+					++found;
+			}
+		}
+		return found;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t pos = Find(headKey);
+		if(pos == (size_t)-1)
+			return;
+
+		// the probes of other keys stop on the overflow counts, not on the
+		// tags, so the slot is empty again right away
+		m_Tag[pos] = BUCKET_TAG_EMPTY;
+		for(size_t bucket = Bucket(BucketHash(headKey)); bucket != pos / BUCKET_SLOT_COUNT; )
+		{
+			if(m_Overflow[bucket] != BUCKET_OVERFLOW_STICKY)
+				--m_Overflow[bucket];
+			if(++bucket == m_BucketCount)
+				bucket = 0;
+		}
+
+		NodeType* pNode = &this->m_NodeBuffer[pos];
+		pNode->Key.KeyValue = 0;
+		memset(&pNode->Value, 0, sizeof(ValueT));
+		this->Vacate(pos);
+
+		--this->m_TableMetaInfo->dwUsed;
+	}
+
+	float Capacity()
+	{
+		if(!this->m_TableMetaInfo || !m_BucketCount)
+			return 1;
+		return (float)this->m_TableMetaInfo->dwUsed / (m_BucketCount * BUCKET_SLOT_COUNT);
+	}
+
+	BucketHashTable() :
+		m_Tag(NULL),
+		m_Overflow(NULL),
+		m_BucketCount(0)
+	{
+	}
+
+protected:
+	static inline uint64_t BucketHash(typename KeyTranslate<KeyT>::HeadType headKey)
+	{
+		return MixRowKey(HashRowKey(headKey), 0);
+	}
+
+	inline size_t Bucket(uint64_t hash)
+	{
+		if(m_BucketCount == 1)
+			return 0;
+		return m_BucketModulo.Mod(hash >> 7);
+	}
+
+	size_t Find(typename KeyTranslate<KeyT>::HeadType headKey)
+	{
+		uint64_t hash = BucketHash(headKey);
+		uint8_t tag = BUCKET_TAG_FULL | (hash & 0x7F);
+
+		size_t bucket = Bucket(hash);
+		for(uint32_t probe=0; probe<m_BucketCount; ++probe)
+		{
+			uint8_t* pTag = &m_Tag[bucket * BUCKET_SLOT_COUNT];
+			for(uint32_t match = BucketMatch(pTag, tag); match; match &= match - 1)
+			{
+				size_t pos = bucket * BUCKET_SLOT_COUNT + __builtin_ctz(match);
+				if(this->m_NodeBuffer[pos].Key.KeyValue == headKey)
+					return pos;
+			}
+
+			if(m_Overflow[bucket] == 0)
+				break;
+
+			if(++bucket == m_BucketCount)
+				bucket = 0;
+		}
+		return (size_t)-1;
+	}
+
+	ValueT* HashKeyValue(typename KeyTranslate<KeyT>::HeadType headKey, bool bNew)
+	{
+		uint64_t hash = BucketHash(headKey);
+		uint8_t tag = BUCKET_TAG_FULL | (hash & 0x7F);
+		size_t emptyPos = (size_t)-1;
+
+		size_t home = Bucket(hash);
+		size_t bucket = home;
+		for(uint32_t probe=0; probe<m_BucketCount; ++probe)
+		{
+			uint8_t* pTag = &m_Tag[bucket * BUCKET_SLOT_COUNT];
+			for(uint32_t match = BucketMatch(pTag, tag); match; match &= match - 1)
+			{
+				NodeType* pNode = &this->m_NodeBuffer[bucket * BUCKET_SLOT_COUNT + __builtin_ctz(match)];
+				if(pNode->Key.KeyValue == headKey)
+					return &pNode->Value;
+			}
+
+			if(bNew && emptyPos == (size_t)-1)
+			{
+				uint32_t free = BucketMatchFree(pTag);
+				if(free)
+					emptyPos = bucket * BUCKET_SLOT_COUNT + __builtin_ctz(free);
+			}
+
+			// no key went past this bucket, a new one still has to find a free slot
+			if(m_Overflow[bucket] == 0 && (!bNew || emptyPos != (size_t)-1))
+				break;
+
+			if(++bucket == m_BucketCount)
+				bucket = 0;
+		}
+
+		if(!bNew || emptyPos == (size_t)-1)
+			return NULL;
+
+		for(bucket = home; bucket != emptyPos / BUCKET_SLOT_COUNT; )
+		{
+			if(m_Overflow[bucket] != BUCKET_OVERFLOW_STICKY)
+				++m_Overflow[bucket];
+			if(++bucket == m_BucketCount)
+				bucket = 0;
+		}
+
+		NodeType* pEmptyNode = &this->m_NodeBuffer[emptyPos];
+		m_Tag[emptyPos] = tag;
+		pEmptyNode->Key.KeyValue = headKey;
+		memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+		this->Occupy(emptyPos);
+
+		++this->m_TableMetaInfo->dwUsed;
+		return &pEmptyNode->Value;
+	}
+
+	uint8_t* m_Tag;
+	uint8_t* m_Overflow;
+	uint32_t m_BucketCount;
+	FastModulo m_BucketModulo;
+};
+
+#endif // define __BUCKETHASHTABLE_HPP__
+
@@ -0,0 +1,151 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.04.14
+ *
+*--*/
+#ifndef __CACHEHASHTABLE_HPP__
+#define __CACHEHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define CACHEHASHTABLE_MAGIC    "CACHHASH"
+
+// saturation of the per node reference counter
+#ifndef HASHTABLE_CACHE_REFERENCE
+	#define HASHTABLE_CACHE_REFERENCE	3
+#endif
+
+template<typename KeyT>
+struct CacheHashNodeHead
+{
+	typename KeyTranslate<KeyT>::HeadType KeyValue;
+	uint8_t Reference;
+} __attribute__((packed));
+
+template<typename KeyT, typename ValueT, typename HeadT>
+class CacheHashTable;
+
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<CacheHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return CACHEHASHTABLE_MAGIC;
+    }
+};
+
+// HashTable used as a bounded cache: every hit bumps a small reference
+// counter of the node, and an insert whose row nodes are all taken evicts
+// the candidate with the lowest counter (the first row on a tie) instead
+// of failing. The counters of the other candidates are aged by one, so a
+// node has to keep being hit to stay, a CLOCK sweep over the rows of the
+// key. Lookups write the counter, so the table needs a single writer even
+// when it is only read.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class CacheHashTable :
+	public AbstractHashTable<KeyT, ValueT, CacheHashNodeHead<KeyT>, CacheHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, CacheHashNodeHead<KeyT>, CacheHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+	typedef HashNode<KeyT, ValueT, CacheHashNodeHead<KeyT> > NodeType;
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		return Hash(key, bNew, NullEvictCallback());
+	}
+
+	// callback(keyValue, pValue) is called before a node is evicted
+	template<typename CallbackT>
+	ValueT* Hash(KeyT key, bool bNew, CallbackT callback)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		NodeType* pEmptyNode = NULL;
+		NodeType* pVictimNode = NULL;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pNode->Key.KeyValue == headKey)
+			{
+				if(pNode->Key.Reference < HASHTABLE_CACHE_REFERENCE)
+					++pNode->Key.Reference;
+				return &pNode->Value;
+			}
+
+			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
+				pEmptyNode = pNode;
+
+			if(pVictimNode == NULL || pNode->Key.Reference < pVictimNode->Key.Reference)
+				pVictimNode = pNode;
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(!bNew)
+			return NULL;
+
+		if(pEmptyNode != NULL)
+		{
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+			++this->m_TableMetaInfo->dwUsed;
+		}
+		else
+		{
+			Age(headKey, pVictimNode);
+			callback(pVictimNode->Key.KeyValue, &pVictimNode->Value);
+			pEmptyNode = pVictimNode;
+		}
+
+		pEmptyNode->Key.KeyValue = headKey;
+		pEmptyNode->Key.Reference = 1;
+		memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+		return &pEmptyNode->Value;
+	}
+
+	// lookup without touching the reference counter
+	ValueT* Peek(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == headKey)
+				return &pNode->Value;
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+		return NULL;
+	}
+
+protected:
+	void Age(typename KeyTranslate<KeyT>::HeadType headKey, NodeType* pVictimNode)
+	{
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			NodeType* pNode = &this->m_NodeBuffer[this->RowIndex(i, headKey) + offset];
+			if(pNode != pVictimNode && pNode->Key.Reference > 0)
+				--pNode->Key.Reference;
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+};
+
+#endif // define __CACHEHASHTABLE_HPP__
+
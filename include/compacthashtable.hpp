@@ -0,0 +1,418 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.04.09
+ *
+*--*/
+#ifndef __COMPACTHASHTABLE_HPP__
+#define __COMPACTHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define COMPACTHASHTABLE_MAGIC          "COMPHASH"
+#define COMPACTTIMERHASHTABLE_MAGIC     "COMPTIME"
+#define COMPACTHASHTABLE_VERSION        0x0201
+
+// relative timestamps are rebased once now gets this far from the epoch
+#ifndef COMPACTHASHTABLE_REBASE
+	#define COMPACTHASHTABLE_REBASE     0x80000000U
+#endif
+
+template<typename KeyT>
+struct CompactHashNodeHead
+{
+	uint32_t KeyValue;
+} __attribute__((packed));
+
+// Timestamp is the expire time in units since the epoch of the table
+template<typename KeyT>
+struct CompactTimerHashNodeHead
+{
+	uint32_t KeyValue;
+	uint32_t Timestamp;
+} __attribute__((packed));
+
+template<typename KeyT, typename ValueT, typename HeadT>
+class CompactHashTable;
+template<typename KeyT, typename ValueT, typename HeadT, typename TimeProviderT, uint32_t ResolutionValue>
+class CompactTimerHashTable;
+
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<CompactHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return COMPACTHASHTABLE_MAGIC;
+    }
+};
+template<typename KeyT, typename ValueT, typename HeadT, typename TimeProviderT, uint32_t ResolutionValue>
+struct HashFunction<CompactTimerHashTable<KeyT, ValueT, HeadT, TimeProviderT, ResolutionValue> > {
+    static const char* Magic()
+    {
+        return COMPACTTIMERHASHTABLE_MAGIC;
+    }
+};
+
+// HashTable whose nodes keep a 32 bit fingerprint (HashFingerprint) of the
+// key instead of the 64 bit key hash. The row of a node is still chosen by
+// the full hash, so two keys only get confused when they share a row node
+// and a fingerprint; use VerifiedHashTable where that is not acceptable.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class CompactHashTable :
+	public AbstractHashTable<KeyT, ValueT, CompactHashNodeHead<KeyT>, CompactHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, CompactHashNodeHead<KeyT>, CompactHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+	typedef HashNode<KeyT, ValueT, CompactHashNodeHead<KeyT> > NodeType;
+
+	static inline uint16_t GetVersion()
+	{
+		return COMPACTHASHTABLE_VERSION;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint32_t fingerprint = HashFingerprint(headKey);
+		NodeType* pEmptyNode = NULL;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
+				pEmptyNode = pNode;
+
+			if(pNode->Key.KeyValue == fingerprint)
+				return &pNode->Value;
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			pEmptyNode->Key.KeyValue = fingerprint;
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+
+			++this->m_TableMetaInfo->dwUsed;
+			return &pEmptyNode->Value;
+		}
+		return NULL;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint32_t fingerprint = HashFingerprint(headKey);
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == fingerprint)
+			{
+				pNode->Key.KeyValue = 0;
+				memset(&pNode->Value, 0, sizeof(ValueT));
+				this->Vacate(pos);
+
+				--this->m_TableMetaInfo->dwUsed;
+				break;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+};
+
+// TimerHashTable with the node layout of CompactHashTable plus a 32 bit
+// expire time, counted in units of ResolutionValue TimeProviderT ticks
+// from an epoch kept in dwReserved[0] (low) and dwReserved[1] (high).
+// The epoch is set by the first insert and moved forward, rewriting every
+// node, when now gets COMPACTHASHTABLE_REBASE units away from it; with
+// SecondTimeProvider that never happens in practice, with
+// MicroSecondTimeProvider pick a resolution that keeps it rare. Timeouts
+// beyond the 32 bit range are cut to it.
+template<typename KeyT, typename ValueT, typename HeadT = void, typename TimeProviderT = SecondTimeProvider, uint32_t ResolutionValue = 1>
+class CompactTimerHashTable :
+	public AbstractHashTable<KeyT, ValueT, CompactTimerHashNodeHead<KeyT>,
+				CompactTimerHashTable<KeyT, ValueT, HeadT, TimeProviderT, ResolutionValue>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, CompactTimerHashNodeHead<KeyT>,
+				CompactTimerHashTable<KeyT, ValueT, HeadT, TimeProviderT, ResolutionValue>, HeadT> AbstractType;
+	typedef HashNode<KeyT, ValueT, CompactTimerHashNodeHead<KeyT> > NodeType;
+	typedef typename TimeProviderT::TimeType TimeType;
+
+	CompactTimerHashTable()
+	{
+		m_DefaultTimeout = m_TimeProvider.FromTicks(0);
+	}
+
+	static inline uint16_t GetVersion()
+	{
+		return COMPACTHASHTABLE_VERSION;
+	}
+
+	// skips expired nodes
+	NodeType* NextNode(HashTableIterator* pstIterator)
+	{
+		if(!this->m_TableMetaInfo)
+			return NULL;
+
+		uint32_t now = Relative(m_TimeProvider.Now());
+
+		NodeType* pNode = NULL;
+		while((pNode = AbstractType::NextNode(pstIterator)) != NULL)
+		{
+			if(pNode->Key.Timestamp > now)
+				return pNode;
+		}
+		return NULL;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		return Hash(key, bNew, m_TimeProvider.Now());
+	}
+
+	ValueT* Hash(KeyT key, bool bNew, TimeType now)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		if(bNew && GetEpoch() == 0)
+			SetEpoch(Units(now));
+
+		uint32_t relative = Relative(now);
+		if(bNew && relative >= COMPACTHASHTABLE_REBASE)
+		{
+			Rebase(relative);
+			relative = 0;
+		}
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint32_t fingerprint = HashFingerprint(headKey);
+		NodeType* pEmptyNode = NULL;
+		bool bIsExpire = false;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL)
+			{
+				if(pNode->Key.KeyValue == 0)
+					pEmptyNode = pNode;
+				else if(pNode->Key.Timestamp <= relative)
+				{
+					pEmptyNode = pNode;
+					bIsExpire = true;
+				}
+			}
+
+			if(pNode->Key.KeyValue == fingerprint)
+			{
+				if(pNode->Key.Timestamp <= relative)
+					break;
+				else
+					return &pNode->Value;
+			}
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			uint64_t timeout = Units(m_DefaultTimeout);
+			if(timeout > 0xFFFFFFFFULL - relative)
+				timeout = 0xFFFFFFFFULL - relative;
+
+			pEmptyNode->Key.KeyValue = fingerprint;
+			pEmptyNode->Key.Timestamp = relative + timeout;
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+
+			if(!bIsExpire)
+			{
+				this->Occupy(pEmptyNode - this->m_NodeBuffer);
+				++this->m_TableMetaInfo->dwUsed;
+			}
+			return &pEmptyNode->Value;
+		}
+		return NULL;
+	}
+
+	// sets the absolute expire time of a live key, returns the previous one
+	// or a zero time when the key is not found
+	TimeType Expire(KeyT key, TimeType timeout)
+	{
+		NodeType* pNode = Find(key);
+		if(!pNode)
+			return m_TimeProvider.FromTicks(0);
+
+		TimeType last = Absolute(pNode->Key.Timestamp);
+
+		uint64_t units = Units(timeout);
+		uint64_t epoch = GetEpoch();
+		if(units <= epoch)
+			pNode->Key.Timestamp = 0;
+		else if(units - epoch > 0xFFFFFFFFULL)
+			pNode->Key.Timestamp = 0xFFFFFFFFU;
+		else
+			pNode->Key.Timestamp = units - epoch;
+		return last;
+	}
+
+	TimeType TTL(KeyT key)
+	{
+		NodeType* pNode = Find(key);
+		if(!pNode)
+			return m_TimeProvider.FromTicks(0);
+		return m_TimeProvider.FromTicks((uint64_t)(pNode->Key.Timestamp - Relative(m_TimeProvider.Now())) * ResolutionValue);
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint32_t fingerprint = HashFingerprint(headKey);
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == fingerprint)
+			{
+				pNode->Key.KeyValue = 0;
+				pNode->Key.Timestamp = 0;
+				memset(&pNode->Value, 0, sizeof(ValueT));
+				this->Vacate(pos);
+
+				--this->m_TableMetaInfo->dwUsed;
+				break;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+
+	inline uint64_t GetEpoch()
+	{
+		if(!this->m_TableMetaInfo)
+			return 0;
+		return ((uint64_t)this->m_TableMetaInfo->dwReserved[1] << 32) | this->m_TableMetaInfo->dwReserved[0];
+	}
+
+	inline TimeProviderT& GetTimeProvider()
+	{
+		return m_TimeProvider;
+	}
+
+	inline void SetTimeProvider(TimeProviderT provider)
+	{
+		m_TimeProvider = provider;
+	}
+
+	inline TimeType GetDefaultTimeout()
+	{
+		return m_DefaultTimeout;
+	}
+
+	inline TimeType SetDefaultTimeout(TimeType timeout)
+	{
+		TimeType last = m_DefaultTimeout;
+		m_DefaultTimeout = timeout;
+		return last;
+	}
+
+protected:
+	inline uint64_t Units(TimeType v)
+	{
+		return m_TimeProvider.Ticks(v) / ResolutionValue;
+	}
+
+	// now in units since the epoch, 0 before it
+	inline uint32_t Relative(TimeType now)
+	{
+		uint64_t units = Units(now);
+		uint64_t epoch = GetEpoch();
+		if(units <= epoch)
+			return 0;
+		if(units - epoch > 0xFFFFFFFFULL)
+			return 0xFFFFFFFFU;
+		return units - epoch;
+	}
+
+	inline TimeType Absolute(uint32_t timestamp)
+	{
+		return m_TimeProvider.FromTicks((GetEpoch() + timestamp) * ResolutionValue);
+	}
+
+	inline void SetEpoch(uint64_t epoch)
+	{
+		this->m_TableMetaInfo->dwReserved[0] = (uint32_t)epoch;
+		this->m_TableMetaInfo->dwReserved[1] = (uint32_t)(epoch >> 32);
+	}
+
+	// moves the epoch shift units forward, nodes that expired before the new
+	// epoch keep expire time 0 until they are reused
+	void Rebase(uint32_t shift)
+	{
+		for(uint32_t pos=0; pos<this->m_TableMetaInfo->dwTotal; ++pos)
+		{
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == 0)
+				continue;
+
+			if(pNode->Key.Timestamp <= shift)
+				pNode->Key.Timestamp = 0;
+			else
+				pNode->Key.Timestamp -= shift;
+		}
+		SetEpoch(GetEpoch() + shift);
+	}
+
+	NodeType* Find(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint32_t fingerprint = HashFingerprint(headKey);
+		uint32_t now = Relative(m_TimeProvider.Now());
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == fingerprint)
+				return (pNode->Key.Timestamp > now)?pNode:NULL;
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+		return NULL;
+	}
+
+	TimeProviderT m_TimeProvider;
+	TimeType m_DefaultTimeout;
+};
+
+#endif // define __COMPACTHASHTABLE_HPP__
+
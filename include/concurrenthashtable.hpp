@@ -0,0 +1,513 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.03.10
+ *
+*--*/
+#ifndef __CONCURRENTHASHTABLE_HPP__
+#define __CONCURRENTHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define SEQLOCKHASHTABLE_MAGIC      "SEQLHASH"
+#define ATOMICHASHTABLE_MAGIC       "ATOMHASH"
+
+#define ATOMICHASHTABLE_CLEAR		0x80000000
+
+// padded so the node size is a multiple of 8: with the table head
+// rounded up as well, Sequence is aligned in every node and its loads and
+// stores are single-copy atomic.
+template<typename KeyT, typename ValueT>
+struct SeqLockHashNodeHead
+{
+	// odd while the writer is modifying the node
+	volatile uint32_t Sequence;
+	typename KeyTranslate<KeyT>::HeadType KeyValue;
+	char Padding[(8 - (sizeof(uint32_t) + sizeof(typename KeyTranslate<KeyT>::HeadType) + sizeof(ValueT)) % 8) % 8];
+} __attribute__((packed));
+
+// key and value both start on an 8 byte boundary and the node size is
+// a multiple of 8, so KeyValue and aligned value fields can be used with
+// the __sync builtins.
+template<typename KeyT>
+struct AtomicHashNodeHead
+{
+	typename KeyTranslate<KeyT>::HeadType KeyValue;
+	char Padding[(8 - sizeof(typename KeyTranslate<KeyT>::HeadType) % 8) % 8];
+} __attribute__((packed));
+
+template<typename ValueT>
+struct AtomicHashValue
+{
+	ValueT Value;
+	char Padding[(8 - sizeof(ValueT) % 8) % 8];
+} __attribute__((packed));
+
+template<typename KeyT, typename ValueT, typename HeadT>
+class SeqLockHashTable;
+template<typename KeyT, typename ValueT, typename HeadT>
+class AtomicHashTable;
+
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<SeqLockHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return SEQLOCKHASHTABLE_MAGIC;
+    }
+};
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<AtomicHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return ATOMICHASHTABLE_MAGIC;
+    }
+};
+
+// one writer, any number of lock-free readers (threads or processes
+// sharing a SharedMemoryStorage). Readers copy values out with Get() and
+// retry while a node's sequence is odd or has changed; only the writer
+// may call Set/BeginUpdate/EndUpdate/Clear.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class SeqLockHashTable :
+	public AbstractHashTable<KeyT, ValueT, SeqLockHashNodeHead<KeyT, ValueT>, SeqLockHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef HashNode<KeyT, ValueT, SeqLockHashNodeHead<KeyT, ValueT> > NodeType;
+
+	static inline uint32_t GetHeadSize(uint32_t seedCount)
+	{
+		uint32_t headSize = sizeof(HashTableMetaInfo<HeadT>) + seedCount * sizeof(uint32_t);
+		return (headSize + 7) & ~7;
+	}
+
+	bool Get(KeyT key, ValueT* pValue)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer || !pValue)
+			return false;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			if(ReadNode(&this->m_NodeBuffer[pos], headKey, pValue))
+				return true;
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+		return false;
+	}
+
+	bool Next(HashTableIterator* pstIterator, ValueT* pValue)
+	{
+		if(!pstIterator || !this->m_TableMetaInfo || !this->m_NodeBuffer || !pValue)
+			return false;
+
+		for(; pstIterator->BufferIndex<this->m_TableMetaInfo->cSeedCount; ++pstIterator->BufferIndex)
+		{
+			for(; pstIterator->Seed<this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex]; ++pstIterator->Seed)
+			{
+				size_t pos = pstIterator->Seed + pstIterator->Offset;
+				if(pos >= pstIterator->End)
+					return false;
+
+				if(this->m_Occupancy && this->m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK] == 0)
+				{
+					pstIterator->Seed += HASHTABLE_OCCUPANCY_BLOCK - pos % HASHTABLE_OCCUPANCY_BLOCK - 1;
+					continue;
+				}
+
+				if(ReadNode(&this->m_NodeBuffer[pos], 0, pValue))
+				{
+					++pstIterator->Seed;
+					return true;
+				}
+			}
+			pstIterator->Offset += this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex];
+			pstIterator->Seed = 0;
+		}
+		return false;
+	}
+
+	bool Set(KeyT key, const ValueT& value)
+	{
+		ValueT* pValue = BeginUpdate(key, true);
+		if(pValue == NULL)
+			return false;
+
+		memcpy(pValue, &value, sizeof(ValueT));
+		EndUpdate(pValue);
+		return true;
+	}
+
+	// writer only: opens the node of key for in-place modification,
+	// readers of that node spin until EndUpdate() is called.
+	ValueT* BeginUpdate(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		NodeType* pEmptyNode = NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
+				pEmptyNode = pNode;
+
+			if(pNode->Key.KeyValue == headKey)
+			{
+				++pNode->Key.Sequence;
+				WRITE_BARRIER();
+				return &pNode->Value;
+			}
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			++pEmptyNode->Key.Sequence;
+			WRITE_BARRIER();
+
+			pEmptyNode->Key.KeyValue = headKey;
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+
+            ++this->m_TableMetaInfo->dwUsed;
+			return &pEmptyNode->Value;
+		}
+		return NULL;
+	}
+
+	void EndUpdate(ValueT* pValue)
+	{
+		if(pValue == NULL)
+			return;
+
+		NodeType* pNode = (NodeType*)((char*)pValue - sizeof(SeqLockHashNodeHead<KeyT, ValueT>));
+		WRITE_BARRIER();
+		++pNode->Key.Sequence;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == headKey)
+			{
+				++pNode->Key.Sequence;
+				WRITE_BARRIER();
+
+				pNode->Key.KeyValue = 0;
+				memset(&pNode->Value, 0, sizeof(ValueT));
+				this->Vacate(pos);
+
+				WRITE_BARRIER();
+				++pNode->Key.Sequence;
+
+                --this->m_TableMetaInfo->dwUsed;
+				break;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+
+protected:
+	// copies the node value when it holds headKey (any key if headKey is 0)
+	inline bool ReadNode(NodeType* pNode, typename KeyTranslate<KeyT>::HeadType headKey, ValueT* pValue)
+	{
+		for(;;)
+		{
+			uint32_t sequence = pNode->Key.Sequence;
+			if(sequence & 1)
+			{
+				CPU_RELAX();
+				continue;
+			}
+			READ_BARRIER();
+
+			typename KeyTranslate<KeyT>::HeadType keyValue = pNode->Key.KeyValue;
+			bool bMatch = (keyValue != 0 && (headKey == 0 || keyValue == headKey));
+			if(bMatch)
+				memcpy(pValue, (const void*)&pNode->Value, sizeof(ValueT));
+
+			READ_BARRIER();
+			if(pNode->Key.Sequence == sequence)
+				return bMatch;
+		}
+	}
+};
+
+// any number of writers (threads or processes sharing a storage).
+// Empty nodes are claimed with a CAS on KeyValue, in row order, and the
+// used count is kept with atomic adds in an aligned slot at the end of the
+// table head. A free node always holds a zeroed value, so a claimed node
+// is ready without a memset; Clear(key) must not race with updates of the
+// same key.
+//
+// A key must never end up in two nodes, yet the row order claim only
+// holds while no node becomes empty: a Clear() between two writers of a
+// key would let the second claim an earlier row than the first. So the
+// claim of a new key and Clear() exclude each other through a word of the
+// same slot, claims sharing it and Clear() taking it alone. Lookups and
+// updates of existing keys take no lock; a process that dies inside a
+// claim or a Clear() blocks later ones.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class AtomicHashTable :
+	public AbstractHashTable<KeyT, AtomicHashValue<ValueT>, AtomicHashNodeHead<KeyT>, AtomicHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef HashNode<KeyT, AtomicHashValue<ValueT>, AtomicHashNodeHead<KeyT> > NodeType;
+
+	static inline uint32_t GetHeadSize(uint32_t seedCount)
+	{
+		uint32_t headSize = sizeof(HashTableMetaInfo<HeadT>) + seedCount * sizeof(uint32_t);
+		return ((headSize + 7) & ~7) + sizeof(AtomicHashCounter);
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator)
+	{
+		return (ValueT*)AbstractType::Next(pstIterator);
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(AtomicLoad(GetKeyValue(pNode)) == headKey)
+				return GetValue(pNode);
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(!bNew)
+			return NULL;
+
+		LockClaim();
+		ValueT* pValue = Claim(headKey);
+		UnlockClaim();
+		return pValue;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		// looked up with the lock held: a node found before it could be
+		// freed by another Clear() and claimed for another key meanwhile
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		LockClear();
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(AtomicLoad(GetKeyValue(pNode)) == headKey)
+			{
+				memset(GetValue(pNode), 0, sizeof(AtomicHashValue<ValueT>));
+				MEMORY_BARRIER();
+
+				if(AtomicCompareExchange(GetKeyValue(pNode), headKey, (typename KeyTranslate<KeyT>::HeadType)0) == headKey)
+				{
+					if(this->m_Occupancy)
+						AtomicFetchAdd(&this->m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK], (uint8_t)-1);
+					AtomicFetchAdd(&GetCounter()->dwUsed, (uint32_t)-1);
+				}
+				break;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+		UnlockClear();
+	}
+
+	// integral ValueT: atomically adds delta to the value of key
+	bool FetchAdd(KeyT key, ValueT delta, ValueT* pPrevious = NULL, bool bNew = true)
+	{
+		ValueT* pValue = Hash(key, bNew);
+		if(pValue == NULL)
+			return false;
+
+		ValueT previous = AtomicFetchAdd(pValue, delta);
+		if(pPrevious)
+			*pPrevious = previous;
+		return true;
+	}
+
+	// integral field of a struct ValueT, e.g. FetchAdd(key, &Value::dwCount, 1)
+	template<typename StructT, typename FieldT>
+	bool FetchAdd(KeyT key, FieldT StructT::*field, FieldT delta, FieldT* pPrevious = NULL, bool bNew = true)
+	{
+		ValueT* pValue = Hash(key, bNew);
+		if(pValue == NULL)
+			return false;
+
+		FieldT previous = AtomicFetchAdd(&(pValue->*field), delta);
+		if(pPrevious)
+			*pPrevious = previous;
+		return true;
+	}
+
+	bool CompareExchange(KeyT key, ValueT expected, ValueT desired, ValueT* pPrevious = NULL, bool bNew = true)
+	{
+		ValueT* pValue = Hash(key, bNew);
+		if(pValue == NULL)
+			return false;
+
+		ValueT previous = AtomicCompareExchange(pValue, expected, desired);
+		if(pPrevious)
+			*pPrevious = previous;
+		return previous == expected;
+	}
+
+	template<typename StructT, typename FieldT>
+	bool CompareExchange(KeyT key, FieldT StructT::*field, FieldT expected, FieldT desired, FieldT* pPrevious = NULL, bool bNew = true)
+	{
+		ValueT* pValue = Hash(key, bNew);
+		if(pValue == NULL)
+			return false;
+
+		FieldT previous = AtomicCompareExchange(&(pValue->*field), expected, desired);
+		if(pPrevious)
+			*pPrevious = previous;
+		return previous == expected;
+	}
+
+	float Capacity()
+	{
+		if(!this->m_TableMetaInfo)
+			return 1;
+		return (float)AtomicLoad(&GetCounter()->dwUsed) / this->m_TableMetaInfo->dwTotal;
+	}
+
+	static inline typename KeyTranslate<KeyT>::HeadType* GetKeyValue(void* pNode)
+	{
+		return (typename KeyTranslate<KeyT>::HeadType*)pNode;
+	}
+
+	static inline ValueT* GetValue(NodeType* pNode)
+	{
+		return (ValueT*)((char*)pNode + sizeof(AtomicHashNodeHead<KeyT>));
+	}
+
+protected:
+	typedef AbstractHashTable<KeyT, AtomicHashValue<ValueT>, AtomicHashNodeHead<KeyT>, AtomicHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+
+	// the last 8 bytes of the head, an 8 byte boundary of the buffer
+	struct AtomicHashCounter
+	{
+		uint32_t dwUsed;
+		// claims in progress, plus ATOMICHASHTABLE_CLEAR while a Clear() runs
+		uint32_t dwClaim;
+	};
+
+	inline AtomicHashCounter* GetCounter()
+	{
+		return (AtomicHashCounter*)((char*)this->m_TableMetaInfo + this->m_TableMetaInfo->dwHeadSize - sizeof(AtomicHashCounter));
+	}
+
+	// with claims held off: returns the node of headKey, or claims the first
+	// empty one in row order. Writers racing on the same key meet on the
+	// same first empty node and the loser sees the winner's key.
+	ValueT* Claim(typename KeyTranslate<KeyT>::HeadType headKey)
+	{
+		// the key may have been claimed since the lookup, in a later row
+		// than an empty node left by a Clear()
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(AtomicLoad(GetKeyValue(pNode)) == headKey)
+				return GetValue(pNode);
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			typename KeyTranslate<KeyT>::HeadType keyValue = AtomicLoad(GetKeyValue(pNode));
+			if(keyValue == 0)
+			{
+				keyValue = AtomicCompareExchange(GetKeyValue(pNode), (typename KeyTranslate<KeyT>::HeadType)0, headKey);
+				if(keyValue == 0)
+				{
+					if(this->m_Occupancy)
+						AtomicFetchAdd(&this->m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK], (uint8_t)1);
+					AtomicFetchAdd(&GetCounter()->dwUsed, (uint32_t)1);
+					return GetValue(pNode);
+				}
+			}
+
+			if(keyValue == headKey)
+				return GetValue(pNode);
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+		return NULL;
+	}
+
+	inline void LockClaim()
+	{
+		uint32_t* pClaim = &GetCounter()->dwClaim;
+		for(;;)
+		{
+			uint32_t claim = AtomicLoad(pClaim);
+			if(!(claim & ATOMICHASHTABLE_CLEAR) && AtomicCompareExchange(pClaim, claim, claim + 1) == claim)
+				return;
+			CPU_RELAX();
+		}
+	}
+
+	inline void UnlockClaim()
+	{
+		AtomicFetchAdd(&GetCounter()->dwClaim, (uint32_t)-1);
+	}
+
+	// holds off new claims first, then waits for those in progress
+	inline void LockClear()
+	{
+		uint32_t* pClaim = &GetCounter()->dwClaim;
+		while(AtomicFetchOr(pClaim, (uint32_t)ATOMICHASHTABLE_CLEAR) & ATOMICHASHTABLE_CLEAR)
+			CPU_RELAX();
+		while(AtomicLoad(pClaim) != ATOMICHASHTABLE_CLEAR)
+			CPU_RELAX();
+	}
+
+	inline void UnlockClear()
+	{
+		AtomicFetchAnd(&GetCounter()->dwClaim, (uint32_t)~ATOMICHASHTABLE_CLEAR);
+	}
+};
+
+#endif // define __CONCURRENTHASHTABLE_HPP__
+
@@ -0,0 +1,328 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.04.02
+ *
+*--*/
+#ifndef __CUCKOOHASHTABLE_HPP__
+#define __CUCKOOHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+// overflow nodes appended to the buffer by CreateHashTable/GetBufferSize
+#ifndef HASHTABLE_CUCKOO_STASH
+	#define HASHTABLE_CUCKOO_STASH		64
+#endif
+
+// longest displacement path and most nodes looked at by one insert
+#ifndef HASHTABLE_CUCKOO_DEPTH
+	#define HASHTABLE_CUCKOO_DEPTH		4
+#endif
+#ifndef HASHTABLE_CUCKOO_SEARCH
+	#define HASHTABLE_CUCKOO_SEARCH		256
+#endif
+
+template<typename KeyT, typename ValueT, typename HeadT>
+class CuckooHashTable;
+
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<CuckooHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return HASHTABLE_MAGIC;
+    }
+};
+
+struct CuckooStep
+{
+	size_t Position;
+	int32_t Parent;
+	uint32_t Depth;
+};
+
+// HashTable with the same node layout and magic, so existing tables load
+// as is. When every row node of a new key is taken, an occupant is moved
+// to one of its other rows (breadth first, at most HASHTABLE_CUCKOO_DEPTH
+// moves), and only then the key goes to a small stash after the rows.
+//
+// the stash size is whatever the buffer has beyond the rows, kept in
+// dwReserved[2], and dwReserved[3] counts the used stash nodes so lookups
+// skip the stash while it is empty. Any Hash(key, true) may move nodes, a
+// value pointer is only valid until the next insert.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class CuckooHashTable :
+	public AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, CuckooHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, CuckooHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+	typedef HashNode<KeyT, ValueT, HashNodeHead<KeyT> > NodeType;
+
+	static CuckooHashTable<KeyT, ValueT, HeadT> CreateHashTable(Seed& seed, uint32_t stashSize = HASHTABLE_CUCKOO_STASH)
+	{
+		CuckooHashTable<KeyT, ValueT, HeadT> ht;
+
+		size_t bufferSize = GetBufferSize(seed, stashSize);
+		char* buffer = (char*)malloc(bufferSize);
+		if(!buffer)
+			return ht;
+
+		memset(buffer, 0, bufferSize);
+		if(!ht.Initialize(buffer, bufferSize, seed))
+		{
+			free(buffer);
+			return ht;
+		}
+		ht.m_NeedDelete = true;
+		return ht;
+	}
+
+	static CuckooHashTable<KeyT, ValueT, HeadT> LoadHashTable(char* buffer, size_t size, Seed& seed)
+	{
+		CuckooHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(buffer, size, seed);
+		return ht;
+	}
+
+	template<typename StorageT>
+	static CuckooHashTable<KeyT, ValueT, HeadT> LoadHashTable(StorageT storage, Seed& seed)
+	{
+		CuckooHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(storage.GetStorageBuffer(), storage.GetSize(), seed);
+		return ht;
+	}
+
+	static inline size_t GetBufferSize(Seed& seed, uint32_t stashSize = HASHTABLE_CUCKOO_STASH)
+	{
+		return AbstractType::GetBufferSize(seed) + stashSize * sizeof(NodeType);
+	}
+
+	bool Initialize(char* buffer, size_t size, Seed& seed)
+	{
+		size_t tableSize = AbstractType::GetBufferSize(seed);
+		if(!buffer || size < tableSize || (size - tableSize) % sizeof(NodeType) != 0)
+			return false;
+
+		if(!AbstractType::Initialize(buffer, tableSize, seed))
+			return false;
+
+		// a table saved without a stash adopts whatever the storage offers
+		uint32_t stashSize = (size - tableSize) / sizeof(NodeType);
+		if(this->m_TableMetaInfo->dwReserved[2] == 0 && this->m_TableMetaInfo->dwReserved[3] == 0)
+			this->m_TableMetaInfo->dwReserved[2] = stashSize;
+		else if(this->m_TableMetaInfo->dwReserved[2] != stashSize)
+		{
+			this->m_TableMetaInfo = NULL;
+			this->m_NodeBuffer = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		NodeType* pEmptyNode = NULL;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
+				pEmptyNode = pNode;
+
+			if(pNode->Key.KeyValue == headKey)
+				return &pNode->Value;
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		NodeType* pStashNode = FindStash(headKey);
+		if(pStashNode)
+			return &pStashNode->Value;
+
+		if(!bNew)
+			return NULL;
+
+		if(pEmptyNode == NULL)
+			pEmptyNode = Displace(headKey);
+		else
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+
+		if(pEmptyNode == NULL)
+		{
+			pEmptyNode = FindStash(0);
+			if(pEmptyNode == NULL)
+				return NULL;
+			++this->m_TableMetaInfo->dwReserved[3];
+		}
+
+		pEmptyNode->Key.KeyValue = headKey;
+		memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+
+		++this->m_TableMetaInfo->dwUsed;
+		return &pEmptyNode->Value;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == headKey)
+			{
+				pNode->Key.KeyValue = 0;
+				memset(&pNode->Value, 0, sizeof(ValueT));
+				this->Vacate(pos);
+
+				--this->m_TableMetaInfo->dwUsed;
+				return;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		NodeType* pStashNode = FindStash(headKey);
+		if(pStashNode)
+		{
+			pStashNode->Key.KeyValue = 0;
+			memset(&pStashNode->Value, 0, sizeof(ValueT));
+
+			--this->m_TableMetaInfo->dwReserved[3];
+			--this->m_TableMetaInfo->dwUsed;
+		}
+	}
+
+	// rows first, then the stash (part of the last partition)
+	NodeType* NextNode(HashTableIterator* pstIterator)
+	{
+		NodeType* pNode = AbstractType::NextNode(pstIterator);
+		if(pNode || !pstIterator || !this->m_TableMetaInfo || !this->m_NodeBuffer ||
+			pstIterator->BufferIndex < this->m_TableMetaInfo->cSeedCount)
+			return pNode;
+
+		for(; pstIterator->Seed<this->m_TableMetaInfo->dwReserved[2]; ++pstIterator->Seed)
+		{
+			pNode = &this->m_NodeBuffer[this->m_TableMetaInfo->dwTotal + pstIterator->Seed];
+			if(pNode->Key.KeyValue != 0)
+			{
+				++pstIterator->Seed;
+				return pNode;
+			}
+		}
+		return NULL;
+	}
+
+	inline uint32_t GetStashSize()
+	{
+		if(!this->m_TableMetaInfo)
+			return 0;
+		return this->m_TableMetaInfo->dwReserved[2];
+	}
+
+	inline uint32_t GetStashUsed()
+	{
+		if(!this->m_TableMetaInfo)
+			return 0;
+		return this->m_TableMetaInfo->dwReserved[3];
+	}
+
+protected:
+	NodeType* FindStash(typename KeyTranslate<KeyT>::HeadType headKey)
+	{
+		// an empty stash is never scanned for a key
+		if(headKey != 0 && this->m_TableMetaInfo->dwReserved[3] == 0)
+			return NULL;
+
+		NodeType* pStash = &this->m_NodeBuffer[this->m_TableMetaInfo->dwTotal];
+		for(uint32_t i=0; i<this->m_TableMetaInfo->dwReserved[2]; ++i)
+		{
+			if(pStash[i].Key.KeyValue == headKey)
+				return &pStash[i];
+		}
+		return NULL;
+	}
+
+	bool InPath(CuckooStep* pSteps, int32_t index, size_t pos)
+	{
+		for(; index >= 0; index = pSteps[index].Parent)
+		{
+			if(pSteps[index].Position == pos)
+				return true;
+		}
+		return false;
+	}
+
+	// breadth first search of a path from a row node of headKey to an empty
+	// node, nothing is written until a path is found. The moves are then
+	// applied from the empty end, and the freed row node of headKey returned.
+	NodeType* Displace(typename KeyTranslate<KeyT>::HeadType headKey)
+	{
+		CuckooStep steps[HASHTABLE_CUCKOO_SEARCH];
+		int32_t count = 0;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount && count<HASHTABLE_CUCKOO_SEARCH; ++i)
+		{
+			steps[count].Position = this->RowIndex(i, headKey) + offset;
+			steps[count].Parent = -1;
+			steps[count].Depth = 1;
+			++count;
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		for(int32_t index=0; index<count; ++index)
+		{
+			typename KeyTranslate<KeyT>::HeadType keyValue = this->m_NodeBuffer[steps[index].Position].Key.KeyValue;
+
+			offset = 0;
+			for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+			{
+				size_t pos = this->RowIndex(i, keyValue) + offset;
+				offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+
+				if(InPath(steps, index, pos))
+					continue;
+
+				if(this->m_NodeBuffer[pos].Key.KeyValue == 0)
+				{
+					this->Occupy(pos);
+					for(int32_t step=index; step >= 0; step = steps[step].Parent)
+					{
+						memcpy(&this->m_NodeBuffer[pos], &this->m_NodeBuffer[steps[step].Position], sizeof(NodeType));
+						pos = steps[step].Position;
+					}
+					return &this->m_NodeBuffer[pos];
+				}
+
+				if(steps[index].Depth < HASHTABLE_CUCKOO_DEPTH && count < HASHTABLE_CUCKOO_SEARCH)
+				{
+					steps[count].Position = pos;
+					steps[count].Parent = index;
+					steps[count].Depth = steps[index].Depth + 1;
+					++count;
+				}
+			}
+		}
+		return NULL;
+	}
+};
+
+#endif // define __CUCKOOHASHTABLE_HPP__
+
@@ -10,8 +10,12 @@
 
 #include <utility>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <time.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "utility.hpp"
 #include "keyutility.hpp"
 #include "storage.hpp"
@@ -20,6 +24,21 @@
 	#define TIMERHASHTABLE_TIMEOUT	-1
 #endif
 
+#ifndef HASHTABLE_SEED_MAX
+	#define HASHTABLE_SEED_MAX			250
+#endif
+
+// keys HashMany() walks in lockstep, and so the most lines it has in
+// flight: about what the line fill buffers of a core can track
+#ifndef HASHTABLE_PREFETCH_BATCH
+	#define HASHTABLE_PREFETCH_BATCH	16
+#endif
+
+// nodes summarized by one occupancy counter, at most 255
+#ifndef HASHTABLE_OCCUPANCY_BLOCK
+	#define HASHTABLE_OCCUPANCY_BLOCK	64
+#endif
+
 struct SecondTimeProvider
 {
 	typedef time_t TimeType;
@@ -29,6 +48,16 @@ struct SecondTimeProvider
 		return time(NULL);
 	}
 
+	inline uint64_t Ticks(TimeType v)
+	{
+		return (uint64_t)v;
+	}
+
+	inline TimeType FromTicks(uint64_t ticks)
+	{
+		return (TimeType)ticks;
+	}
+
 	inline TimeType Before(TimeType v1, TimeType v2)
 	{
 		return v1 - v2;
@@ -61,6 +90,19 @@ struct MicroSecondTimeProvider
 		return tv;
 	}
 
+	inline uint64_t Ticks(TimeType v)
+	{
+		return (uint64_t)v.tv_sec * 1000000 + v.tv_usec;
+	}
+
+	inline TimeType FromTicks(uint64_t ticks)
+	{
+		timeval tv;
+		tv.tv_sec = ticks / 1000000;
+		tv.tv_usec = ticks % 1000000;
+		return tv;
+	}
+
 	inline TimeType Before(TimeType v1, TimeType v2)
 	{
 		timeval tv;
@@ -91,8 +133,142 @@ struct MicroSecondTimeProvider
 	}
 };
 
+// same clocks read from CLOCK_REALTIME_COARSE, which is served from the
+// vdso without a clock read (a few milliseconds of resolution). Realtime
+// rather than monotonic, the timestamps are kept in the table storage and
+// have to survive a reboot.
+struct CoarseSecondTimeProvider :
+	public SecondTimeProvider
+{
+	inline TimeType Now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+		return ts.tv_sec;
+	}
+};
+
+struct CoarseMicroSecondTimeProvider :
+	public MicroSecondTimeProvider
+{
+	inline TimeType Now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+
+		timeval tv;
+		tv.tv_sec = ts.tv_sec;
+		tv.tv_usec = ts.tv_nsec / 1000;
+		return tv;
+	}
+};
+
+// reads Now() from a clock cell (BaseT::Ticks of the time) that a
+// TimeTicker keeps current, so a lookup costs one load. The cell may live
+// in shared memory and be ticked by another process; without a cell the
+// provider falls back to BaseT::Now().
+template<typename BaseT = SecondTimeProvider>
+struct CachedTimeProvider :
+	public BaseT
+{
+	typedef typename BaseT::TimeType TimeType;
+
+	CachedTimeProvider() :
+		m_Clock(NULL)
+	{
+	}
+
+	CachedTimeProvider(volatile uint64_t* pClock) :
+		m_Clock(pClock)
+	{
+	}
+
+	inline TimeType Now()
+	{
+		if(!m_Clock)
+			return BaseT::Now();
+		return this->FromTicks(*m_Clock);
+	}
+
+	volatile uint64_t* m_Clock;
+};
+
+// thread writing BaseT::Now() into a clock cell every interval microseconds
+template<typename BaseT = SecondTimeProvider>
+class TimeTicker
+{
+public:
+	TimeTicker() :
+		m_Clock(NULL),
+		m_Interval(0),
+		m_Running(false)
+	{
+	}
+
+	bool Start(volatile uint64_t* pClock, uint32_t interval)
+	{
+		if(m_Running || !pClock || interval == 0)
+			return false;
+
+		m_Clock = pClock;
+		m_Interval = interval;
+		*m_Clock = m_Provider.Ticks(m_Provider.Now());
+
+		m_Running = true;
+		if(pthread_create(&m_Thread, NULL, TickThread, this) != 0)
+		{
+			m_Running = false;
+			return false;
+		}
+		return true;
+	}
+
+	void Stop()
+	{
+		if(!m_Running)
+			return;
+
+		m_Running = false;
+		pthread_join(m_Thread, NULL);
+	}
+
+	inline bool IsRunning()
+	{
+		return m_Running;
+	}
+
+	~TimeTicker()
+	{
+		Stop();
+	}
+
+private:
+	// the thread holds this, a copy would join it twice
+	TimeTicker(const TimeTicker<BaseT>&);
+	TimeTicker<BaseT>& operator=(const TimeTicker<BaseT>&);
+
+protected:
+	static void* TickThread(void* pArgument)
+	{
+		TimeTicker<BaseT>* pTicker = (TimeTicker<BaseT>*)pArgument;
+		while(pTicker->m_Running)
+		{
+			usleep(pTicker->m_Interval);
+			*pTicker->m_Clock = pTicker->m_Provider.Ticks(pTicker->m_Provider.Now());
+		}
+		return NULL;
+	}
+
+	BaseT m_Provider;
+	volatile uint64_t* m_Clock;
+	uint32_t m_Interval;
+	volatile bool m_Running;
+	pthread_t m_Thread;
+};
+
 #define HASHTABLE_MAGIC         "HASHTABL"
 #define TIMERHASHTABLE_MAGIC    "TIMEHASH"
+#define VERIFIEDHASHTABLE_MAGIC "VERIHASH"
 #define HASHTABLE_VERSION       0x0101
 
 template<typename HeadT>
@@ -143,6 +319,52 @@ struct TimerHashNodeHead
 	TimeType Timestamp;
 } __attribute__((packed));
 
+// KeyValue is only the 64 bit fingerprint of Key, a probe compares it
+// first and reads the full key only when it matches.
+template<typename KeyT>
+struct VerifiedHashNodeHead
+{
+	typename KeyTranslate<KeyT>::HeadType KeyValue;
+	typename RemoveReference<KeyT>::Type Key;
+} __attribute__((packed));
+
+// expiry index of a TimerHashTable: a wheel of dwWheelSize buckets of
+// ddwGranularity ticks each, every bucket a circular list threaded through
+// TimerExpiryLink entries (one per node, then one sentinel per bucket).
+struct TimerExpiryHead
+{
+	uint32_t dwWheelSize;
+	uint64_t ddwGranularity;
+	uint64_t ddwCursor;
+} __attribute__((packed));
+
+struct TimerExpiryLink
+{
+	uint32_t Prev;
+	uint32_t Next;
+} __attribute__((packed));
+
+struct NullEvictCallback
+{
+	template<typename HeadType, typename ValueT>
+	inline void operator()(HeadType keyValue, ValueT* pValue)
+	{
+	}
+};
+
+// lookup and insert counters of a table. ddwHit[i] and ddwInsert[i] count
+// the keys found or placed in row i, so their spread over the rows shows
+// how deep the probes go.
+struct HashTableStatistics
+{
+	uint64_t ddwHit[HASHTABLE_SEED_MAX];
+	uint64_t ddwInsert[HASHTABLE_SEED_MAX];
+
+	// lookups of absent keys, and inserts that found every row node taken
+	uint64_t ddwMiss;
+	uint64_t ddwInsertFail;
+};
+
 template<typename KeyT, typename ValueT, typename NodeHeadT>
 struct HashNode
 {
@@ -157,12 +379,74 @@ struct HashTableIterator
 	size_t	Offset;
 	size_t	Seed;
 	size_t	BufferIndex;
+
+	// node position the iteration stops at, see Partition()
+	size_t	End;
+};
+
+template<typename HashTableT, typename CallbackT>
+struct HashTableForEachContext
+{
+	HashTableT* pTable;
+	HashTableIterator Iterator;
+	CallbackT* pCallback;
+};
+
+// a node of a bulk load that still looks for a row: its key, position in
+// the row being placed and index in the input nodes
+struct HashTableBulkEntry
+{
+	uint64_t ddwKeyValue;
+	uint32_t dwPos;
+	uint32_t dwIndex;
+};
+
+enum HashTableBulkPhase
+{
+	HASHTABLE_BULK_POSITION,
+	HASHTABLE_BULK_SCATTER,
+	HASHTABLE_BULK_PLACE
+};
+
+// one thread of a bulk load: it hashes and scatters the dwIndex-th chunk
+// of the waiting entries, then places the dwIndex-th partition of the row
+template<typename HashTableT, typename NodeT>
+struct HashTableBulkContext
+{
+	HashTableT* pTable;
+	NodeT* pNodes;
+	HashTableBulkEntry* pEntry;
+	HashTableBulkEntry* pSorted;
+
+	// entries of chunk t in partition p at [t * dwThreads + p], turned
+	// into the scatter offsets, and the partition bounds in pSorted
+	size_t* pOffset;
+	size_t* pBound;
+
+	uint32_t dwIndex;
+	uint32_t dwThreads;
+	size_t ddwCount;
+
+	uint8_t cRow;
+	size_t ddwRowOffset;
+	uint32_t dwRowSize;
+	HashTableBulkPhase ePhase;
+
+	size_t ddwLoaded;
+	size_t ddwLeft;
 };
 
 template<typename KeyT, typename ValueT, typename HeadT>
 class HashTable;
 template<typename KeyT, typename ValueT, typename HeadT, typename TimeProviderT>
 class TimerHashTable;
+template<typename KeyT, typename ValueT, typename HeadT>
+class VerifiedHashTable;
+
+template<typename KeyT, typename ValueT, typename SeedListT, typename HeadT>
+class StaticHashTable;
+template<typename KeyT, typename ValueT, typename HeadT>
+class IncrementalHashTable;
 
 template<typename T>
 struct HashFunction;
@@ -180,6 +464,44 @@ struct HashFunction<TimerHashTable<KeyT, ValueT, HeadT, TimeProviderT> > {
         return TIMERHASHTABLE_MAGIC;
     }
 };
+template<typename KeyT, typename ValueT, typename HeadT>
+struct HashFunction<VerifiedHashTable<KeyT, ValueT, HeadT> > {
+    static const char* Magic()
+    {
+        return VERIFIEDHASHTABLE_MAGIC;
+    }
+};
+template<typename KeyT, typename ValueT, typename SeedListT, typename HeadT>
+struct HashFunction<StaticHashTable<KeyT, ValueT, SeedListT, HeadT> > {
+    static const char* Magic()
+    {
+        return HASHTABLE_MAGIC;
+    }
+};
+
+// 32 bit node fingerprint of a key of a compact table. Narrow keys are
+// kept as they are, wider ones are mixed so that keys sharing a row still
+// differ in their fingerprint.
+template<typename HeadType>
+inline uint32_t HashFingerprint(HeadType headKey)
+{
+	if(sizeof(HeadType) <= sizeof(uint32_t))
+		return (uint32_t)headKey;
+
+	uint32_t fingerprint = (uint32_t)(((uint64_t)headKey * 0x9E3779B97F4A7C15ULL) >> 32);
+	return fingerprint?fingerprint:1;
+}
+
+// narrow keys are widened the same way the built-in '%' did, so row
+// positions (and therefore existing tables) do not change.
+template<typename HeadType>
+inline uint64_t HashRowKey(HeadType headKey)
+{
+	if(sizeof(HeadType) > sizeof(uint32_t))
+		return (uint64_t)headKey;
+	else
+		return (uint32_t)headKey;
+}
 
 template<typename KeyT, typename ValueT, typename NodeHeadT, typename HashTableT, typename HeadT>
 class AbstractHashTable
@@ -189,21 +511,22 @@ public:
 	{
         HashTableT ht;
 
-        if(seed.GetSize() > 250)
+        if(seed.GetSize() > HASHTABLE_SEED_MAX)
             return ht;
 
         uint32_t nodeCount = seed.GetCount();
-        uint32_t headSize = sizeof(HashTableMetaInfo<HeadT>) + seed.GetSize() * sizeof(uint32_t);
+        uint32_t headSize = HashTableT::GetHeadSize(seed.GetSize());
         size_t bufferSize = headSize + nodeCount * sizeof(HashNode<KeyT, ValueT, NodeHeadT>);
 
         ht.m_TableMetaInfo = (HashTableMetaInfo<HeadT>*)malloc(bufferSize);
         if(!ht.m_TableMetaInfo)
             return ht;
 
+        memset(ht.m_TableMetaInfo, 0, bufferSize);
 		ht.m_NeedDelete = true;
 
         memcpy(ht.m_TableMetaInfo->cMagic, HashFunction<HashTableT>::Magic(), 8);
-        ht.m_TableMetaInfo->wVersion = HASHTABLE_VERSION;
+        ht.m_TableMetaInfo->wVersion = HashTableT::GetVersion();
         ht.m_TableMetaInfo->dwHeadSize = headSize;
         ht.m_TableMetaInfo->ddwMemSize = bufferSize;
         ht.m_TableMetaInfo->dwTotal = nodeCount;
@@ -214,6 +537,7 @@ public:
             ht.m_TableMetaInfo->dwSeedBuffer[i] = seed.GetSeed(i);
 
 		ht.m_NodeBuffer = (HashNode<KeyT, ValueT, NodeHeadT>*)((char*)ht.m_TableMetaInfo + headSize);
+		ht.InitializeRows();
 		return ht;
 	}
 
@@ -239,18 +563,21 @@ public:
 
     bool Initialize(char* buffer, size_t size, Seed& seed)
     {
+        if(seed.GetSize() > HASHTABLE_SEED_MAX)
+            return false;
+
         m_TableMetaInfo = (HashTableMetaInfo<HeadT>*)buffer;
 
         if(memcmp(m_TableMetaInfo->cMagic, "\0\0\0\0\0\0\0\0", 8) == 0)
         {
             // uninitialize storage
             memcpy(m_TableMetaInfo->cMagic, HashFunction<HashTableT>::Magic(), 8);
-            m_TableMetaInfo->wVersion = HASHTABLE_VERSION;
+            m_TableMetaInfo->wVersion = HashTableT::GetVersion();
 
             m_TableMetaInfo->dwTotal = seed.GetCount();
             m_TableMetaInfo->dwUsed = 0;
 
-            m_TableMetaInfo->dwHeadSize = sizeof(HashTableMetaInfo<HeadT>) + seed.GetSize() * sizeof(uint32_t);
+            m_TableMetaInfo->dwHeadSize = HashTableT::GetHeadSize(seed.GetSize());
             m_TableMetaInfo->ddwMemSize = m_TableMetaInfo->dwHeadSize + sizeof(HashNode<KeyT, ValueT, NodeHeadT>) * m_TableMetaInfo->dwTotal;
 
             m_TableMetaInfo->cSeedCount = seed.GetSize();
@@ -264,15 +591,16 @@ public:
             }
 
             m_NodeBuffer = (HashNode<KeyT, ValueT, NodeHeadT>*)(buffer + m_TableMetaInfo->dwHeadSize);
+            InitializeRows();
             return true;
         }
         else
         {
             if(memcmp(m_TableMetaInfo->cMagic, HashFunction<HashTableT>::Magic(), 8) != 0 ||
-                m_TableMetaInfo->wVersion != HASHTABLE_VERSION ||
+                m_TableMetaInfo->wVersion != HashTableT::GetVersion() ||
                 m_TableMetaInfo->cSeedCount != seed.GetSize() ||
                 m_TableMetaInfo->dwTotal != seed.GetCount() ||
-                m_TableMetaInfo->dwHeadSize != (sizeof(HashTableMetaInfo<HeadT>) + seed.GetSize() * sizeof(uint32_t)) ||
+                m_TableMetaInfo->dwHeadSize != HashTableT::GetHeadSize(seed.GetSize()) ||
                 m_TableMetaInfo->ddwMemSize != size)
             {
                 m_TableMetaInfo = NULL;
@@ -289,10 +617,27 @@ public:
             }
 
             m_NodeBuffer = (HashNode<KeyT, ValueT, NodeHeadT>*)(buffer + m_TableMetaInfo->dwHeadSize);
+            InitializeRows();
             return true;
         }
     }
 
+	static inline uint32_t GetHeadSize(uint32_t seedCount)
+	{
+		return sizeof(HashTableMetaInfo<HeadT>) + seedCount * sizeof(uint32_t);
+	}
+
+	static inline uint16_t GetVersion()
+	{
+		return HASHTABLE_VERSION;
+	}
+
+	// whether the probes of the table call RecordHit/RecordInsert/RecordMiss
+	static inline bool HasStatistics()
+	{
+		return false;
+	}
+
 	static inline size_t GetNodeSize()
 	{
 		return sizeof(HashNode<KeyT, ValueT, NodeHeadT>);
@@ -300,7 +645,7 @@ public:
 
 	static inline size_t GetBufferSize(Seed& seed)
 	{
-        uint32_t headSize = sizeof(HashTableMetaInfo<HeadT>) + seed.GetSize() * sizeof(uint32_t);
+        uint32_t headSize = HashTableT::GetHeadSize(seed.GetSize());
         return headSize + seed.GetCount() * sizeof(HashNode<KeyT, ValueT, NodeHeadT>);
 	}
 
@@ -311,6 +656,184 @@ public:
         return &m_TableMetaInfo->stHead;
     }
 
+	// iterator over the index-th of count equal node ranges, iterators of
+	// different partitions can be consumed by different threads.
+	HashTableIterator Partition(uint32_t index, uint32_t count)
+	{
+		HashTableIterator iter;
+		if(!m_TableMetaInfo || index >= count)
+		{
+			iter.End = 0;
+			return iter;
+		}
+
+		size_t begin = (uint64_t)m_TableMetaInfo->dwTotal * index / count;
+		if(index + 1 < count)
+			iter.End = (uint64_t)m_TableMetaInfo->dwTotal * (index + 1) / count;
+
+		for(; iter.BufferIndex<m_TableMetaInfo->cSeedCount &&
+				begin >= iter.Offset + m_TableMetaInfo->dwSeedBuffer[iter.BufferIndex]; ++iter.BufferIndex)
+			iter.Offset += m_TableMetaInfo->dwSeedBuffer[iter.BufferIndex];
+		iter.Seed = begin - iter.Offset;
+		return iter;
+	}
+
+	HashNode<KeyT, ValueT, NodeHeadT>* NextNode(HashTableIterator* pstIterator)
+	{
+		if(!pstIterator || !m_TableMetaInfo || !m_NodeBuffer)
+			return NULL;
+
+		for(; pstIterator->BufferIndex<m_TableMetaInfo->cSeedCount; ++pstIterator->BufferIndex)
+		{
+			for(; pstIterator->Seed<m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex]; ++pstIterator->Seed)
+			{
+				size_t pos = pstIterator->Seed + pstIterator->Offset;
+				if(pos >= pstIterator->End)
+					return NULL;
+
+				// skip the rest of an empty block without touching its nodes
+				if(m_Occupancy && m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK] == 0)
+				{
+					pstIterator->Seed += HASHTABLE_OCCUPANCY_BLOCK - pos % HASHTABLE_OCCUPANCY_BLOCK - 1;
+					continue;
+				}
+
+				HashNode<KeyT, ValueT, NodeHeadT>* pNode = &m_NodeBuffer[pos];
+				if(pNode->Key.KeyValue != 0)
+				{
+					++pstIterator->Seed;
+					return pNode;
+				}
+			}
+			pstIterator->Offset += m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex];
+			pstIterator->Seed = 0;
+		}
+		return NULL;
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator)
+	{
+		HashNode<KeyT, ValueT, NodeHeadT>* pNode = static_cast<HashTableT*>(this)->NextNode(pstIterator);
+		if(!pNode)
+			return NULL;
+		return &pNode->Value;
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator, typename KeyTranslate<KeyT>::HeadType* pKeyValue)
+	{
+		HashNode<KeyT, ValueT, NodeHeadT>* pNode = static_cast<HashTableT*>(this)->NextNode(pstIterator);
+		if(!pNode)
+			return NULL;
+
+		if(pKeyValue)
+			*pKeyValue = pNode->Key.KeyValue;
+		return &pNode->Value;
+	}
+
+	// calls callback(keyValue, pValue) for every node, from threads threads
+	// that each scan one Partition(); callback must be thread safe.
+	template<typename CallbackT>
+	void ParallelForEach(CallbackT callback, uint32_t threads)
+	{
+		if(!m_TableMetaInfo || !m_NodeBuffer || threads == 0)
+			return;
+
+		std::vector<HashTableForEachContext<HashTableT, CallbackT> > vContext(threads);
+		std::vector<pthread_t> vThread(threads);
+		std::vector<bool> vStarted(threads, false);
+		for(uint32_t i=0; i<threads; ++i)
+		{
+			vContext[i].pTable = static_cast<HashTableT*>(this);
+			vContext[i].Iterator = Partition(i, threads);
+			vContext[i].pCallback = &callback;
+
+			if(i + 1 < threads && pthread_create(&vThread[i], NULL, ForEachThread<CallbackT>, &vContext[i]) == 0)
+				vStarted[i] = true;
+			else
+				ForEachThread<CallbackT>(&vContext[i]);
+		}
+
+		for(uint32_t i=0; i<threads; ++i)
+		{
+			if(vStarted[i])
+				pthread_join(vThread[i], NULL);
+		}
+	}
+
+	inline size_t GetOccupancySize()
+	{
+		if(!m_TableMetaInfo)
+			return 0;
+		return (m_TableMetaInfo->dwTotal + HASHTABLE_OCCUPANCY_BLOCK - 1) / HASHTABLE_OCCUPANCY_BLOCK;
+	}
+
+	// one used node counter per HASHTABLE_OCCUPANCY_BLOCK nodes, rebuilt here
+	// with a full pass and then kept by the inserts and Clear() of this
+	// object, so scans skip empty blocks without reading them.
+	bool AttachOccupancy(uint8_t* buffer, size_t size)
+	{
+		if(!m_TableMetaInfo || !m_NodeBuffer || !buffer || size < GetOccupancySize())
+			return false;
+
+		memset(buffer, 0, GetOccupancySize());
+		for(size_t pos=0; pos<m_TableMetaInfo->dwTotal; ++pos)
+		{
+			if(m_NodeBuffer[pos].Key.KeyValue != 0)
+				++buffer[pos / HASHTABLE_OCCUPANCY_BLOCK];
+		}
+		m_Occupancy = buffer;
+		return true;
+	}
+
+	inline void DetachOccupancy()
+	{
+		m_Occupancy = NULL;
+	}
+
+	// used nodes of row, counted with a pass over the row
+	uint32_t GetRowUsed(uint8_t row)
+	{
+		if(!m_TableMetaInfo || !m_NodeBuffer || row >= m_TableMetaInfo->cSeedCount)
+			return 0;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<row; ++i)
+			offset += m_TableMetaInfo->dwSeedBuffer[i];
+
+		uint32_t used = 0;
+		for(uint32_t i=0; i<m_TableMetaInfo->dwSeedBuffer[row]; ++i)
+		{
+			if(m_NodeBuffer[offset + i].Key.KeyValue != 0)
+				++used;
+		}
+		return used;
+	}
+
+	// counts the hits, inserts and failures of this object into
+	// pStatistics (cleared here) until DetachStatistics(). Only HashTable,
+	// TimerHashTable and VerifiedHashTable record them (see
+	// HasStatistics()); the other tables return false and stay detached.
+	inline bool AttachStatistics(HashTableStatistics* pStatistics)
+	{
+		if(!HashTableT::HasStatistics())
+			return false;
+
+		if(pStatistics)
+			memset(pStatistics, 0, sizeof(HashTableStatistics));
+		m_Statistics = pStatistics;
+		return true;
+	}
+
+	inline void DetachStatistics()
+	{
+		m_Statistics = NULL;
+	}
+
+	inline HashTableStatistics* GetStatistics()
+	{
+		return m_Statistics;
+	}
+
 	void Clear(KeyT key)
 	{
         if(!m_TableMetaInfo)
@@ -320,12 +843,13 @@ public:
 		size_t offset = 0;
 		for(uint8_t i=0; i<m_TableMetaInfo->cSeedCount; ++i)
 		{
-			size_t pos = (headKey % m_TableMetaInfo->dwSeedBuffer[i] + offset);
+			size_t pos = (RowIndex(i, headKey) + offset);
 			HashNode<KeyT, ValueT, NodeHeadT>* pNode = &m_NodeBuffer[pos];
 			if(pNode->Key.KeyValue == headKey)
 			{
 				pNode->Key.KeyValue = 0;
 				memset(&pNode->Value, 0, sizeof(ValueT));
+				Vacate(pos);
 
                 --m_TableMetaInfo->dwUsed;
 				break;
@@ -360,64 +884,288 @@ public:
 	AbstractHashTable() :
 		m_NeedDelete(false),
 		m_TableMetaInfo(NULL),
-		m_NodeBuffer(NULL)
+		m_NodeBuffer(NULL),
+		m_Occupancy(NULL),
+		m_Statistics(NULL)
 	{
 	}
 
 protected:
-	bool m_NeedDelete;
-
-    HashTableMetaInfo<HeadT>* m_TableMetaInfo;
-	HashNode<KeyT, ValueT, NodeHeadT>* m_NodeBuffer;
-};
-
-template<typename KeyT, typename ValueT, typename HeadT = void>
-class HashTable :
-	public AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, HashTable<KeyT, ValueT, HeadT>, HeadT>
-{
-public:
-	ValueT* Next(HashTableIterator* pstIterator)
+	void InitializeRows()
 	{
-		if(!pstIterator || !this->m_TableMetaInfo || !this->m_NodeBuffer)
-			return NULL;
-
-		for(; pstIterator->BufferIndex<this->m_TableMetaInfo->cSeedCount; ++pstIterator->BufferIndex)
+		for(uint8_t i=0; i<m_TableMetaInfo->cSeedCount; ++i)
 		{
-			for(; pstIterator->Seed<this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex]; ++pstIterator->Seed)
-			{
-				size_t pos = pstIterator->Seed + pstIterator->Offset;
-				HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pNode = &this->m_NodeBuffer[pos];
-				if(pNode->Key.KeyValue != 0)
-				{
-					++pstIterator->Seed;
-					return &pNode->Value;
-				}
-			}
-			pstIterator->Offset += this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex];
-			pstIterator->Seed = 0;
+			uint32_t size = m_TableMetaInfo->dwSeedBuffer[i];
+			m_RowMask[i] = IsPowerOfTwoRow(size)?size - 1:0;
+			if(!m_RowMask[i])
+				m_RowModulo[i].Initialize(size);
 		}
-		return NULL;
 	}
 
-	ValueT* Hash(KeyT key, bool bNew = false)
+	inline size_t RowIndex(uint8_t i, typename KeyTranslate<KeyT>::HeadType headKey)
 	{
-        if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
-            return NULL;
+		if(m_RowMask[i])
+			return MixRowKey(HashRowKey(headKey), i) & m_RowMask[i];
+		return m_RowModulo[i].Mod(HashRowKey(headKey));
+	}
 
-		HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pEmptyNode = NULL;
+	inline void Occupy(size_t pos)
+	{
+		if(m_Occupancy)
+			++m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK];
+	}
 
-		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
-		size_t offset = 0;
+	inline void Vacate(size_t pos)
+	{
+		if(m_Occupancy)
+			--m_Occupancy[pos / HASHTABLE_OCCUPANCY_BLOCK];
+	}
+
+	inline void RecordHit(uint8_t row)
+	{
+		if(m_Statistics)
+			++m_Statistics->ddwHit[row];
+	}
+
+	inline void RecordInsert(size_t pos)
+	{
+		if(!m_Statistics)
+			return;
+
+		uint8_t row = 0;
+		for(; row+1<m_TableMetaInfo->cSeedCount && pos>=m_TableMetaInfo->dwSeedBuffer[row]; ++row)
+			pos -= m_TableMetaInfo->dwSeedBuffer[row];
+		++m_Statistics->ddwInsert[row];
+	}
+
+	inline void RecordMiss(bool bNew)
+	{
+		if(!m_Statistics)
+			return;
+
+		if(bNew)
+			++m_Statistics->ddwInsertFail;
+		else
+			++m_Statistics->ddwMiss;
+	}
+
+	template<typename CallbackT>
+	static void* ForEachThread(void* arg)
+	{
+		HashTableForEachContext<HashTableT, CallbackT>* pContext = (HashTableForEachContext<HashTableT, CallbackT>*)arg;
+
+		HashNode<KeyT, ValueT, NodeHeadT>* pNode = NULL;
+		while((pNode = pContext->pTable->NextNode(&pContext->Iterator)) != NULL)
+			(*pContext->pCallback)(pNode->Key.KeyValue, &pNode->Value);
+		return NULL;
+	}
+
+	// walks the rows of a batch of keys in lockstep: row i of every key not
+	// matched in an earlier row is prefetched, then checked. At most count
+	// lines are in flight at a time, and the lookups of the batch that
+	// follow find the rows they read cached.
+	inline void Prefetch(const typename KeyTranslate<KeyT>::HeadType* headKeys, size_t count)
+	{
+		uint8_t active[HASHTABLE_PREFETCH_BATCH];
+		size_t activeCount = 0;
+		for(size_t k=0; k<count && k<HASHTABLE_PREFETCH_BATCH; ++k)
+			active[activeCount++] = k;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<m_TableMetaInfo->cSeedCount && activeCount>0; ++i)
+		{
+			for(size_t k=0; k<activeCount; ++k)
+				__builtin_prefetch(&m_NodeBuffer[RowIndex(i, headKeys[active[k]]) + offset]);
+
+			size_t left = 0;
+			for(size_t k=0; k<activeCount; ++k)
+			{
+				if(m_NodeBuffer[RowIndex(i, headKeys[active[k]]) + offset].Key.KeyValue != headKeys[active[k]])
+					active[left++] = active[k];
+			}
+			activeCount = left;
+			offset += m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+
+	bool m_NeedDelete;
+
+    HashTableMetaInfo<HeadT>* m_TableMetaInfo;
+	HashNode<KeyT, ValueT, NodeHeadT>* m_NodeBuffer;
+	uint8_t* m_Occupancy;
+	HashTableStatistics* m_Statistics;
+
+	FastModulo m_RowModulo[HASHTABLE_SEED_MAX];
+	uint32_t m_RowMask[HASHTABLE_SEED_MAX];
+};
+
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class HashTable :
+	public AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, HashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	static inline bool HasStatistics()
+	{
+		return true;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+        if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+            return NULL;
+
+		return HashKeyValue(KeyTranslate<KeyT>::Translate(key), bNew);
+	}
+
+	size_t HashMany(typename RemoveReference<KeyT>::Type* keys, size_t count, ValueT** results, bool bNew = false)
+	{
+		if(!keys || !results)
+			return 0;
+
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+		{
+			memset(results, 0, count * sizeof(ValueT*));
+			return 0;
+		}
+
+		// bring in the rows of a whole batch before the lookups, so the row
+		// misses of its keys overlap instead of serializing.
+		typename KeyTranslate<KeyT>::HeadType headKeys[HASHTABLE_PREFETCH_BATCH];
+		size_t found = 0;
+		for(size_t begin=0; begin<count; begin+=HASHTABLE_PREFETCH_BATCH)
+		{
+			size_t batch = count - begin;
+			if(batch > HASHTABLE_PREFETCH_BATCH)
+				batch = HASHTABLE_PREFETCH_BATCH;
+
+			for(size_t i=0; i<batch; ++i)
+				headKeys[i] = KeyTranslate<KeyT>::Translate(keys[begin + i]);
+			this->Prefetch(headKeys, batch);
+
+			for(size_t i=0; i<batch; ++i)
+			{
+				results[begin + i] = HashKeyValue(headKeys[i], bNew);
+				if(results[begin + i] != NULL)
+					++found;
+			}
+		}
+		return found;
+	}
+
+	typedef HashNode<KeyT, ValueT, HashNodeHead<KeyT> > NodeType;
+	typedef HashTableBulkContext<HashTable<KeyT, ValueT, HeadT>, NodeType> BulkContextType;
+
+	// loads count nodes (a key twice keeps its last value) into an empty
+	// table, row by row with threads threads: the keys still without a node
+	// are hashed to the row in parallel, grouped by position range and
+	// sorted, so every thread writes its part of the row in order. Returns
+	// the keys that fit in no row, moved to the front of nodes; the table
+	// is the same a series of Hash(key, true) could have built.
+	size_t BulkLoad(NodeType* nodes, size_t count, uint32_t threads)
+	{
+		if(!nodes || count == 0)
+			return 0;
+
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer || this->m_TableMetaInfo->dwUsed != 0 ||
+			count > 0xFFFFFFFF || threads == 0)
+			return count;
+
+		std::vector<HashTableBulkEntry> vEntry(count);
+		std::vector<HashTableBulkEntry> vSorted(count);
+		for(size_t i=0; i<count; ++i)
+		{
+			vEntry[i].ddwKeyValue = nodes[i].Key.KeyValue;
+			vEntry[i].dwIndex = i;
+		}
+
+		std::vector<size_t> vOffset(threads * threads);
+		std::vector<size_t> vBound(threads + 1);
+		std::vector<BulkContextType> vContext(threads);
+		for(uint32_t i=0; i<threads; ++i)
+		{
+			vContext[i].pTable = this;
+			vContext[i].pNodes = nodes;
+			vContext[i].pEntry = &vEntry[0];
+			vContext[i].pSorted = &vSorted[0];
+			vContext[i].pOffset = &vOffset[0];
+			vContext[i].pBound = &vBound[0];
+			vContext[i].dwIndex = i;
+			vContext[i].dwThreads = threads;
+		}
+
+		size_t left = count;
+		size_t offset = 0;
+		for(uint8_t row=0; row<this->m_TableMetaInfo->cSeedCount && left>0; ++row)
+		{
+			for(uint32_t i=0; i<threads; ++i)
+			{
+				vContext[i].ddwCount = left;
+				vContext[i].cRow = row;
+				vContext[i].ddwRowOffset = offset;
+				vContext[i].dwRowSize = this->m_TableMetaInfo->dwSeedBuffer[row];
+			}
+
+			std::fill(vOffset.begin(), vOffset.end(), 0);
+			RunBulkPhase(vContext, HASHTABLE_BULK_POSITION);
+
+			size_t next = 0;
+			for(uint32_t p=0; p<threads; ++p)
+			{
+				vBound[p] = next;
+				for(uint32_t t=0; t<threads; ++t)
+				{
+					size_t partCount = vOffset[t * threads + p];
+					vOffset[t * threads + p] = next;
+					next += partCount;
+				}
+			}
+			vBound[threads] = next;
+
+			RunBulkPhase(vContext, HASHTABLE_BULK_SCATTER);
+			RunBulkPhase(vContext, HASHTABLE_BULK_PLACE);
+
+			left = 0;
+			for(uint32_t p=0; p<threads; ++p)
+			{
+				this->m_TableMetaInfo->dwUsed += vContext[p].ddwLoaded;
+				for(size_t i=0; i<vContext[p].ddwLeft; ++i)
+					vEntry[left++] = vSorted[vBound[p] + i];
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[row];
+		}
+
+		if(this->m_Occupancy)
+			this->AttachOccupancy(this->m_Occupancy, this->GetOccupancySize());
+
+		std::vector<NodeType> vLeft(left);
+		for(size_t i=0; i<left; ++i)
+			memcpy(&vLeft[i], &nodes[vEntry[i].dwIndex], sizeof(NodeType));
+		for(size_t i=0; i<left; ++i)
+			memcpy(&nodes[i], &vLeft[i], sizeof(NodeType));
+		return left;
+	}
+
+protected:
+	friend class IncrementalHashTable<KeyT, ValueT, HeadT>;
+
+	ValueT* HashKeyValue(typename KeyTranslate<KeyT>::HeadType headKey, bool bNew)
+	{
+		HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pEmptyNode = NULL;
+
+		size_t offset = 0;
 		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
 		{
-			size_t pos = (headKey % this->m_TableMetaInfo->dwSeedBuffer[i] + offset);
+			size_t pos = (this->RowIndex(i, headKey) + offset);
 			HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pNode = &this->m_NodeBuffer[pos];
 
 			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
 				pEmptyNode = pNode;
 
 			if(pNode->Key.KeyValue == headKey)
+			{
+				this->RecordHit(i);
 				return &pNode->Value;
+			}
 
 			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
 		}
@@ -426,12 +1174,136 @@ public:
 		{
 			pEmptyNode->Key.KeyValue = headKey;
 			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+			this->RecordInsert(pEmptyNode - this->m_NodeBuffer);
 
             ++this->m_TableMetaInfo->dwUsed;
 			return &pEmptyNode->Value;
 		}
+		this->RecordMiss(bNew);
+		return NULL;
+	}
+
+	struct BulkEntryLess
+	{
+		bool operator()(const HashTableBulkEntry& e1, const HashTableBulkEntry& e2) const
+		{
+			if(e1.ddwKeyValue != e2.ddwKeyValue)
+				return e1.ddwKeyValue < e2.ddwKeyValue;
+			return e1.dwIndex < e2.dwIndex;
+		}
+	};
+
+	static void* BulkThread(void* arg)
+	{
+		BulkContextType* pContext = (BulkContextType*)arg;
+		pContext->pTable->BulkPhase(pContext);
 		return NULL;
 	}
+
+	void RunBulkPhase(std::vector<BulkContextType>& vContext, HashTableBulkPhase phase)
+	{
+		std::vector<pthread_t> vThread(vContext.size());
+		std::vector<bool> vStarted(vContext.size(), false);
+		for(size_t i=0; i<vContext.size(); ++i)
+		{
+			vContext[i].ePhase = phase;
+			if(i + 1 < vContext.size() && pthread_create(&vThread[i], NULL, BulkThread, &vContext[i]) == 0)
+				vStarted[i] = true;
+			else
+				BulkPhase(&vContext[i]);
+		}
+
+		for(size_t i=0; i<vContext.size(); ++i)
+		{
+			if(vStarted[i])
+				pthread_join(vThread[i], NULL);
+		}
+	}
+
+	void BulkPhase(BulkContextType* pContext)
+	{
+		uint32_t threads = pContext->dwThreads;
+		size_t begin = pContext->ddwCount * pContext->dwIndex / threads;
+		size_t end = pContext->ddwCount * (pContext->dwIndex + 1) / threads;
+
+		if(pContext->ePhase == HASHTABLE_BULK_POSITION)
+		{
+			size_t* pCount = &pContext->pOffset[pContext->dwIndex * threads];
+			for(size_t i=begin; i<end; ++i)
+			{
+				HashTableBulkEntry* pEntry = &pContext->pEntry[i];
+				pEntry->dwPos = this->RowIndex(pContext->cRow, (typename KeyTranslate<KeyT>::HeadType)pEntry->ddwKeyValue);
+				++pCount[(uint64_t)pEntry->dwPos * threads / pContext->dwRowSize];
+			}
+		}
+		else if(pContext->ePhase == HASHTABLE_BULK_SCATTER)
+		{
+			size_t* pOffset = &pContext->pOffset[pContext->dwIndex * threads];
+			for(size_t i=begin; i<end; ++i)
+			{
+				HashTableBulkEntry* pEntry = &pContext->pEntry[i];
+				pContext->pSorted[pOffset[(uint64_t)pEntry->dwPos * threads / pContext->dwRowSize]++] = *pEntry;
+			}
+		}
+		else
+		{
+			// counting sort of the partition by position into its range of
+			// pEntry, free since the scatter; the order of the input is kept
+			HashTableBulkEntry* pEntry = pContext->pEntry;
+			HashTableBulkEntry* pSorted = pContext->pSorted;
+			size_t partBegin = pContext->pBound[pContext->dwIndex];
+			size_t partEnd = pContext->pBound[pContext->dwIndex + 1];
+			uint32_t low = ((uint64_t)pContext->dwIndex * pContext->dwRowSize + threads - 1) / threads;
+			uint32_t high = ((uint64_t)(pContext->dwIndex + 1) * pContext->dwRowSize + threads - 1) / threads;
+
+			std::vector<uint32_t> vPosition(high - low + 1, 0);
+			for(size_t i=partBegin; i<partEnd; ++i)
+				++vPosition[pSorted[i].dwPos - low + 1];
+			for(size_t i=1; i<vPosition.size(); ++i)
+				vPosition[i] += vPosition[i - 1];
+			for(size_t i=partBegin; i<partEnd; ++i)
+				pEntry[partBegin + vPosition[pSorted[i].dwPos - low]++] = pSorted[i];
+
+			// one run per position, the smallest key takes the node and the
+			// others (duplicates merged into their last node) wait for the
+			// next row
+			size_t loaded = 0;
+			size_t out = partBegin;
+			for(size_t i=partBegin; i<partEnd; )
+			{
+				NodeType* pNode = &this->m_NodeBuffer[pContext->ddwRowOffset + pEntry[i].dwPos];
+				bool bEmpty = (pNode->Key.KeyValue == 0);
+
+				size_t runEnd = i + 1;
+				while(runEnd < partEnd && pEntry[runEnd].dwPos == pEntry[i].dwPos)
+					++runEnd;
+				if(runEnd - i > 1)
+					std::sort(pEntry + i, pEntry + runEnd, BulkEntryLess());
+
+				for(size_t run=i; run<runEnd; )
+				{
+					size_t last = run;
+					while(last + 1 < runEnd && pEntry[last + 1].ddwKeyValue == pEntry[run].ddwKeyValue)
+						++last;
+
+					if(bEmpty)
+					{
+						memcpy(pNode, &pContext->pNodes[pEntry[last].dwIndex], sizeof(NodeType));
+						bEmpty = false;
+						++loaded;
+					}
+					else
+						pSorted[out++] = pEntry[last];
+					run = last + 1;
+				}
+				i = runEnd;
+			}
+
+			pContext->ddwLoaded = loaded;
+			pContext->ddwLeft = out - partBegin;
+		}
+	}
 };
 
 template<typename KeyT, typename ValueT, typename HeadT = void, typename TimeProviderT = SecondTimeProvider>
@@ -442,31 +1314,33 @@ class TimerHashTable :
                 HeadT>
 {
 public:
-	TimerHashTable() :
-		m_DefaultTimeout(0)
+	static inline bool HasStatistics()
 	{
+		return true;
 	}
 
-	ValueT* Next(HashTableIterator* pstIterator)
+	typedef AbstractHashTable<KeyT, ValueT, 
+				TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType>, 
+				TimerHashTable<KeyT, ValueT, HeadT, TimeProviderT>,
+				HeadT> AbstractType;
+
+	TimerHashTable() :
+		m_DefaultTimeout(0),
+		m_ExpiryHead(NULL),
+		m_ExpiryLink(NULL)
 	{
-		if(!pstIterator || !this->m_TableMetaInfo || !this->m_NodeBuffer)
-			return NULL;
+	}
 
+	// skips expired nodes
+	HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* NextNode(HashTableIterator* pstIterator)
+	{
 		typename TimeProviderT::TimeType now = m_TimeProvider.Now();
-		for(; pstIterator->BufferIndex<this->m_TableMetaInfo->cSeedCount; ++pstIterator->BufferIndex)
+
+		HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = NULL;
+		while((pNode = AbstractType::NextNode(pstIterator)) != NULL)
 		{
-			for(; pstIterator->Seed<this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex]; ++pstIterator->Seed)
-			{
-				size_t pos = pstIterator->Seed + pstIterator->Offset;
-				HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[pos];
-				if(pNode->Key.KeyValue != 0 && m_TimeProvider.Compare(pNode->Key.Timestamp, now) > 0)
-				{
-					++pstIterator->Seed;
-					return &pNode->Value;
-				}
-			}
-			pstIterator->Offset += this->m_TableMetaInfo->dwSeedBuffer[pstIterator->BufferIndex];
-			pstIterator->Seed = 0;
+			if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) > 0)
+				return pNode;
 		}
 		return NULL;
 	}
@@ -476,52 +1350,55 @@ public:
 		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
 			return NULL;
 
-		HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pEmptyNode = NULL;
-		TimeProviderT provider;
-		typename TimeProviderT::TimeType now = provider.Now();
+		return HashKeyValue(KeyTranslate<KeyT>::Translate(key), bNew, m_TimeProvider.Now());
+	}
 
-		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
-		size_t offset = 0;
+	// same with the time supplied by the caller, to read the clock once for
+	// a whole batch of operations
+	ValueT* Hash(KeyT key, bool bNew, typename TimeProviderT::TimeType now)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
 
-        bool bIsExpire = false;
-		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
-		{
-			size_t pos = (headKey % this->m_TableMetaInfo->dwSeedBuffer[i] + offset);
-			HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[pos];
+		return HashKeyValue(KeyTranslate<KeyT>::Translate(key), bNew, now);
+	}
 
-			if(pEmptyNode == NULL)
-            {
-                if(pNode->Key.KeyValue == 0)
-                    pEmptyNode = pNode;
-                else if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) <= 0)
-                {
-                    pEmptyNode = pNode;
-                    bIsExpire = true;
-                }
-            }
+	size_t HashMany(typename RemoveReference<KeyT>::Type* keys, size_t count, ValueT** results, bool bNew = false)
+	{
+		return HashMany(keys, count, results, bNew, m_TimeProvider.Now());
+	}
 
-			if(pNode->Key.KeyValue == headKey)
-			{
-				if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) <= 0)
-					break;
-				else
-					return &pNode->Value;
-			}
+	size_t HashMany(typename RemoveReference<KeyT>::Type* keys, size_t count, ValueT** results, bool bNew, typename TimeProviderT::TimeType now)
+	{
+		if(!keys || !results)
+			return 0;
 
-			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+		{
+			memset(results, 0, count * sizeof(ValueT*));
+			return 0;
 		}
 
-		if(bNew && pEmptyNode != NULL)
+		typename KeyTranslate<KeyT>::HeadType headKeys[HASHTABLE_PREFETCH_BATCH];
+		size_t found = 0;
+		for(size_t begin=0; begin<count; begin+=HASHTABLE_PREFETCH_BATCH)
 		{
-			pEmptyNode->Key.KeyValue = headKey;
-			pEmptyNode->Key.Timestamp = m_TimeProvider.After(now, m_DefaultTimeout);
-			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			size_t batch = count - begin;
+			if(batch > HASHTABLE_PREFETCH_BATCH)
+				batch = HASHTABLE_PREFETCH_BATCH;
 
-            if(!bIsExpire)
-                ++this->m_TableMetaInfo->dwUsed;
-			return &pEmptyNode->Value;
+			for(size_t i=0; i<batch; ++i)
+				headKeys[i] = KeyTranslate<KeyT>::Translate(keys[begin + i]);
+			this->Prefetch(headKeys, batch);
+
+			for(size_t i=0; i<batch; ++i)
+			{
+				results[begin + i] = HashKeyValue(headKeys[i], bNew, now);
+				if(results[begin + i] != NULL)
+					++found;
+			}
 		}
-		return NULL;
+		return found;
 	}
 
 	typename TimeProviderT::TimeType Expire(KeyT key, typename TimeProviderT::TimeType timeout)
@@ -535,7 +1412,7 @@ public:
 		size_t offset = 0;
 		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
 		{
-			size_t pos = (headKey % this->m_TableMetaInfo->dwSeedBuffer[i] + offset);
+			size_t pos = (this->RowIndex(i, headKey) + offset);
 			HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[pos];
 
 			if(pNode->Key.KeyValue == headKey)
@@ -544,6 +1421,11 @@ public:
 				{
 					typename TimeProviderT::TimeType last = pNode->Key.Timestamp;
 					pNode->Key.Timestamp = timeout;
+					if(m_ExpiryHead)
+					{
+						UnlinkExpiry(pos);
+						LinkExpiry(pos);
+					}
 					return last;
 				}
 				else
@@ -565,7 +1447,7 @@ public:
 		size_t offset = 0;
 		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
 		{
-			size_t pos = (headKey % this->m_TableMetaInfo->dwSeedBuffer[i] + offset);
+			size_t pos = (this->RowIndex(i, headKey) + offset);
 			HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[pos];
 
 			if(pNode->Key.KeyValue == headKey)
@@ -580,6 +1462,154 @@ public:
 		return 0;
 	}
 
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		if(m_ExpiryHead)
+		{
+			typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+			size_t offset = 0;
+			for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+			{
+				size_t pos = (this->RowIndex(i, headKey) + offset);
+				if(this->m_NodeBuffer[pos].Key.KeyValue == headKey)
+				{
+					UnlinkExpiry(pos);
+					break;
+				}
+				offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+			}
+		}
+		AbstractType::Clear(key);
+	}
+
+	inline size_t GetExpirySize(uint32_t wheelSize)
+	{
+		if(!this->m_TableMetaInfo)
+			return 0;
+		return sizeof(TimerExpiryHead) + ((size_t)this->m_TableMetaInfo->dwTotal + wheelSize) * sizeof(TimerExpiryLink);
+	}
+
+	// indexes every node by expire time in a wheel of wheelSize buckets of
+	// granularity ticks (TimeProviderT::Ticks), so Sweep() only visits nodes
+	// that are due. The index is rebuilt here with a full pass and then kept
+	// by the inserts, Expire() and Clear() of this object.
+	bool AttachExpiry(char* buffer, size_t size, uint32_t wheelSize, uint64_t granularity)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer || !buffer ||
+			wheelSize < 2 || granularity == 0 || size < GetExpirySize(wheelSize))
+			return false;
+
+		m_ExpiryHead = (TimerExpiryHead*)buffer;
+		m_ExpiryLink = (TimerExpiryLink*)(buffer + sizeof(TimerExpiryHead));
+
+		m_ExpiryHead->dwWheelSize = wheelSize;
+		m_ExpiryHead->ddwGranularity = granularity;
+		m_ExpiryHead->ddwCursor = m_TimeProvider.Ticks(m_TimeProvider.Now()) / granularity;
+
+		uint32_t count = this->m_TableMetaInfo->dwTotal + wheelSize;
+		for(uint32_t i=0; i<count; ++i)
+		{
+			m_ExpiryLink[i].Prev = i;
+			m_ExpiryLink[i].Next = i;
+		}
+
+		for(uint32_t pos=0; pos<this->m_TableMetaInfo->dwTotal; ++pos)
+		{
+			if(this->m_NodeBuffer[pos].Key.KeyValue != 0)
+				LinkExpiry(pos);
+		}
+		return true;
+	}
+
+	inline void DetachExpiry()
+	{
+		m_ExpiryHead = NULL;
+		m_ExpiryLink = NULL;
+	}
+
+	// reclaims expired nodes, looking at no more than limit nodes and
+	// buckets per call, and calls callback(keyValue, pValue) before each
+	// node is cleared. Only buckets whose tick has fully elapsed are swept,
+	// so a node is reclaimed at most one granularity after it expired.
+	// Meant to be called in small slices from the thread that owns the
+	// table; *pDone tells whether the wheel has caught up with now, a slice
+	// may reclaim nothing and still leave work behind.
+	template<typename CallbackT>
+	uint32_t Sweep(uint32_t limit, CallbackT callback, bool* pDone = NULL)
+	{
+		if(pDone)
+			*pDone = true;
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer || !m_ExpiryHead)
+			return 0;
+
+		typename TimeProviderT::TimeType now = m_TimeProvider.Now();
+		uint64_t nowTick = m_TimeProvider.Ticks(now) / m_ExpiryHead->ddwGranularity;
+
+		uint32_t examined = 0;
+		uint32_t reclaimed = 0;
+		while(m_ExpiryHead->ddwCursor < nowTick)
+		{
+			uint32_t sentinel = this->m_TableMetaInfo->dwTotal + m_ExpiryHead->ddwCursor % m_ExpiryHead->dwWheelSize;
+
+			uint32_t index = m_ExpiryLink[sentinel].Next;
+			while(index != sentinel && examined < limit)
+			{
+				uint32_t next = m_ExpiryLink[index].Next;
+				HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[index];
+
+				UnlinkExpiry(index);
+				if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) <= 0)
+				{
+					callback(pNode->Key.KeyValue, &pNode->Value);
+
+					pNode->Key.KeyValue = 0;
+					memset(&pNode->Value, 0, sizeof(ValueT));
+					this->Vacate(index);
+
+					--this->m_TableMetaInfo->dwUsed;
+					++reclaimed;
+				}
+				else
+				{
+					// beyond the wheel when linked, move it forward
+					LinkExpiry(index);
+				}
+
+				++examined;
+				index = next;
+			}
+
+			if(examined >= limit)
+			{
+				if(pDone)
+					*pDone = false;
+				break;
+			}
+
+			++m_ExpiryHead->ddwCursor;
+			++examined;
+		}
+		return reclaimed;
+	}
+
+	inline uint32_t Sweep(uint32_t limit, bool* pDone = NULL)
+	{
+		return Sweep(limit, NullEvictCallback(), pDone);
+	}
+
+	inline TimeProviderT& GetTimeProvider()
+	{
+		return m_TimeProvider;
+	}
+
+	inline void SetTimeProvider(TimeProviderT provider)
+	{
+		m_TimeProvider = provider;
+	}
+
 	inline typename TimeProviderT::TimeType GetDefaultTimeout()
 	{
 		return m_DefaultTimeout;
@@ -593,8 +1623,333 @@ public:
 	}
 
 protected:
+	ValueT* HashKeyValue(typename KeyTranslate<KeyT>::HeadType headKey, bool bNew, typename TimeProviderT::TimeType now)
+	{
+		HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pEmptyNode = NULL;
+		size_t offset = 0;
+
+        bool bIsExpire = false;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			HashNode<KeyT, ValueT, TimerHashNodeHead<KeyT, typename TimeProviderT::TimeType> >* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL)
+            {
+                if(pNode->Key.KeyValue == 0)
+                    pEmptyNode = pNode;
+                else if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) <= 0)
+                {
+                    pEmptyNode = pNode;
+                    bIsExpire = true;
+                }
+            }
+
+			if(pNode->Key.KeyValue == headKey)
+			{
+				if(m_TimeProvider.Compare(pNode->Key.Timestamp, now) <= 0)
+					break;
+
+				this->RecordHit(i);
+				return &pNode->Value;
+			}
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			pEmptyNode->Key.KeyValue = headKey;
+			pEmptyNode->Key.Timestamp = m_TimeProvider.After(now, m_DefaultTimeout);
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+
+            if(!bIsExpire)
+            {
+                this->Occupy(pEmptyNode - this->m_NodeBuffer);
+                ++this->m_TableMetaInfo->dwUsed;
+            }
+
+			if(m_ExpiryHead)
+			{
+				if(bIsExpire)
+					UnlinkExpiry(pEmptyNode - this->m_NodeBuffer);
+				LinkExpiry(pEmptyNode - this->m_NodeBuffer);
+			}
+			this->RecordInsert(pEmptyNode - this->m_NodeBuffer);
+			return &pEmptyNode->Value;
+		}
+		this->RecordMiss(bNew);
+		return NULL;
+	}
+
+	void LinkExpiry(uint32_t pos)
+	{
+		uint64_t tick = m_TimeProvider.Ticks(this->m_NodeBuffer[pos].Key.Timestamp) / m_ExpiryHead->ddwGranularity;
+		if(tick < m_ExpiryHead->ddwCursor)
+			tick = m_ExpiryHead->ddwCursor;
+		else if(tick >= m_ExpiryHead->ddwCursor + m_ExpiryHead->dwWheelSize)
+			tick = m_ExpiryHead->ddwCursor + m_ExpiryHead->dwWheelSize - 1;
+
+		uint32_t sentinel = this->m_TableMetaInfo->dwTotal + tick % m_ExpiryHead->dwWheelSize;
+		uint32_t next = m_ExpiryLink[sentinel].Next;
+
+		m_ExpiryLink[pos].Prev = sentinel;
+		m_ExpiryLink[pos].Next = next;
+		m_ExpiryLink[next].Prev = pos;
+		m_ExpiryLink[sentinel].Next = pos;
+	}
+
+	void UnlinkExpiry(uint32_t pos)
+	{
+		uint32_t prev = m_ExpiryLink[pos].Prev;
+		uint32_t next = m_ExpiryLink[pos].Next;
+
+		m_ExpiryLink[prev].Next = next;
+		m_ExpiryLink[next].Prev = prev;
+		m_ExpiryLink[pos].Prev = pos;
+		m_ExpiryLink[pos].Next = pos;
+	}
+
 	TimeProviderT m_TimeProvider;
 	typename TimeProviderT::TimeType m_DefaultTimeout;
+
+	TimerExpiryHead* m_ExpiryHead;
+	TimerExpiryLink* m_ExpiryLink;
+};
+
+// HashTable that also stores the key in every node, so two keys sharing a
+// Translate() value are told apart instead of aliasing the same value.
+// KeyT must be a plain old data type (or a reference to one), compared with
+// memcmp like KeyTranslate hashes it.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class VerifiedHashTable :
+	public AbstractHashTable<KeyT, ValueT, VerifiedHashNodeHead<KeyT>, VerifiedHashTable<KeyT, ValueT, HeadT>, HeadT>
+{
+public:
+	static inline bool HasStatistics()
+	{
+		return true;
+	}
+
+	typedef typename RemoveReference<KeyT>::Type KeyType;
+	typedef HashNode<KeyT, ValueT, VerifiedHashNodeHead<KeyT> > NodeType;
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		return HashKeyValue(KeyTranslate<KeyT>::Translate(key), key, bNew);
+	}
+
+	size_t HashMany(KeyType* keys, size_t count, ValueT** results, bool bNew = false)
+	{
+		if(!keys || !results)
+			return 0;
+
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+		{
+			memset(results, 0, count * sizeof(ValueT*));
+			return 0;
+		}
+
+		typename KeyTranslate<KeyT>::HeadType headKeys[HASHTABLE_PREFETCH_BATCH];
+		size_t found = 0;
+		for(size_t begin=0; begin<count; begin+=HASHTABLE_PREFETCH_BATCH)
+		{
+			size_t batch = count - begin;
+			if(batch > HASHTABLE_PREFETCH_BATCH)
+				batch = HASHTABLE_PREFETCH_BATCH;
+
+			for(size_t i=0; i<batch; ++i)
+				headKeys[i] = KeyTranslate<KeyT>::Translate(keys[begin + i]);
+			this->Prefetch(headKeys, batch);
+
+			for(size_t i=0; i<batch; ++i)
+			{
+				results[begin + i] = HashKeyValue(headKeys[i], keys[begin + i], bNew);
+				if(results[begin + i] != NULL)
+					++found;
+			}
+		}
+		return found;
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator, KeyType* pKey = NULL)
+	{
+		ValueT* pValue = AbstractType::Next(pstIterator);
+		if(pValue && pKey)
+		{
+			NodeType* pNode = (NodeType*)((char*)pValue - sizeof(VerifiedHashNodeHead<KeyT>));
+			memcpy(pKey, &pNode->Key.Key, sizeof(KeyType));
+		}
+		return pValue;
+	}
+
+	void Clear(KeyT key)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+			if(pNode->Key.KeyValue == headKey && memcmp(&pNode->Key.Key, &key, sizeof(KeyType)) == 0)
+			{
+				memset(pNode, 0, sizeof(NodeType));
+				this->Vacate(pos);
+
+				--this->m_TableMetaInfo->dwUsed;
+				break;
+			}
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+	}
+
+protected:
+	typedef AbstractHashTable<KeyT, ValueT, VerifiedHashNodeHead<KeyT>, VerifiedHashTable<KeyT, ValueT, HeadT>, HeadT> AbstractType;
+
+	ValueT* HashKeyValue(typename KeyTranslate<KeyT>::HeadType headKey, const KeyType& key, bool bNew)
+	{
+		NodeType* pEmptyNode = NULL;
+
+		size_t offset = 0;
+		for(uint8_t i=0; i<this->m_TableMetaInfo->cSeedCount; ++i)
+		{
+			size_t pos = (this->RowIndex(i, headKey) + offset);
+			NodeType* pNode = &this->m_NodeBuffer[pos];
+
+			if(pEmptyNode == NULL && pNode->Key.KeyValue == 0)
+				pEmptyNode = pNode;
+
+			if(pNode->Key.KeyValue == headKey && memcmp(&pNode->Key.Key, &key, sizeof(KeyType)) == 0)
+			{
+				this->RecordHit(i);
+				return &pNode->Value;
+			}
+
+			offset += this->m_TableMetaInfo->dwSeedBuffer[i];
+		}
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			pEmptyNode->Key.KeyValue = headKey;
+			memcpy(&pEmptyNode->Key.Key, &key, sizeof(KeyType));
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+			this->RecordInsert(pEmptyNode - this->m_NodeBuffer);
+
+			++this->m_TableMetaInfo->dwUsed;
+			return &pEmptyNode->Value;
+		}
+		this->RecordMiss(bNew);
+		return NULL;
+	}
+};
+
+template<typename SeedListT, uint64_t Offset, uint32_t RowValue = 0>
+struct StaticSeedProbe;
+template<uint64_t Offset, uint32_t RowValue>
+struct StaticSeedProbe<NullType, Offset, RowValue>
+{
+	template<typename NodeT, typename HeadType>
+	static inline NodeT* Find(NodeT* pBuffer, uint64_t rowKey, HeadType headKey, NodeT** ppEmptyNode)
+	{
+		return NULL;
+	}
+};
+template<uint32_t Prime, typename NextT, uint64_t Offset, uint32_t RowValue>
+struct StaticSeedProbe<StaticSeed<Prime, NextT>, Offset, RowValue>
+{
+	template<typename NodeT, typename HeadType>
+	static inline NodeT* Find(NodeT* pBuffer, uint64_t rowKey, HeadType headKey, NodeT** ppEmptyNode)
+	{
+		NodeT* pNode = &pBuffer[Offset + (IsPowerOfTwoRow(Prime)?(MixRowKey(rowKey, RowValue) & (Prime - 1)):(rowKey % Prime))];
+
+		if(*ppEmptyNode == NULL && pNode->Key.KeyValue == 0)
+			*ppEmptyNode = pNode;
+
+		if(pNode->Key.KeyValue == headKey)
+			return pNode;
+
+		return StaticSeedProbe<NextT, Offset + Prime, RowValue + 1>::Find(pBuffer, rowKey, headKey, ppEmptyNode);
+	}
+};
+
+// same layout and magic as HashTable, but the primes are a template
+// parameter (see STATICSEED_n), so every probe is unrolled with a
+// constant divisor.
+template<typename KeyT, typename ValueT, typename SeedListT, typename HeadT = void>
+class StaticHashTable :
+	public AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, StaticHashTable<KeyT, ValueT, SeedListT, HeadT>, HeadT>
+{
+public:
+	typedef AbstractHashTable<KeyT, ValueT, HashNodeHead<KeyT>, StaticHashTable<KeyT, ValueT, SeedListT, HeadT>, HeadT> AbstractType;
+
+	static Seed GetSeed()
+	{
+		uint32_t buffer[StaticSeedTraits<SeedListT>::Size];
+		StaticSeedTraits<SeedListT>::Fill(buffer);
+		return Seed(buffer, StaticSeedTraits<SeedListT>::Size);
+	}
+
+	static StaticHashTable<KeyT, ValueT, SeedListT, HeadT> CreateHashTable()
+	{
+		Seed seed = GetSeed();
+		StaticHashTable<KeyT, ValueT, SeedListT, HeadT> ht = AbstractType::CreateHashTable(seed);
+		seed.Release();
+		return ht;
+	}
+
+	static StaticHashTable<KeyT, ValueT, SeedListT, HeadT> LoadHashTable(char* buffer, size_t size)
+	{
+		Seed seed = GetSeed();
+		StaticHashTable<KeyT, ValueT, SeedListT, HeadT> ht = AbstractType::LoadHashTable(buffer, size, seed);
+		seed.Release();
+		return ht;
+	}
+
+	template<typename StorageT>
+	static StaticHashTable<KeyT, ValueT, SeedListT, HeadT> LoadHashTable(StorageT storage)
+	{
+		return LoadHashTable(storage.GetStorageBuffer(), storage.GetSize());
+	}
+
+	static size_t GetBufferSize()
+	{
+		Seed seed = GetSeed();
+		size_t size = AbstractType::GetBufferSize(seed);
+		seed.Release();
+		return size;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!this->m_TableMetaInfo || !this->m_NodeBuffer)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+
+		HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pEmptyNode = NULL;
+		HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pNode = 
+			StaticSeedProbe<SeedListT, 0>::Find(this->m_NodeBuffer, HashRowKey(headKey), headKey, &pEmptyNode);
+		if(pNode != NULL)
+			return &pNode->Value;
+
+		if(bNew && pEmptyNode != NULL)
+		{
+			pEmptyNode->Key.KeyValue = headKey;
+			memset(&pEmptyNode->Value, 0, sizeof(ValueT));
+			this->Occupy(pEmptyNode - this->m_NodeBuffer);
+
+            ++this->m_TableMetaInfo->dwUsed;
+			return &pEmptyNode->Value;
+		}
+		return NULL;
+	}
 };
 
 #endif // define __HASHTABLE_HPP__
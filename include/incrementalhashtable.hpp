@@ -0,0 +1,181 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.03.18
+ *
+*--*/
+#ifndef __INCREMENTALHASHTABLE_HPP__
+#define __INCREMENTALHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+// nodes moved into the new table by every Hash(key, true) while growing
+#ifndef HASHTABLE_MIGRATE_STEP
+	#define HASHTABLE_MIGRATE_STEP		16
+#endif
+
+// grows a HashTable online: Grow() takes a larger table (new Seed, new
+// storage) and the nodes of the current one are moved over a few at a time,
+// so no single call pays for the whole rehash. A key lives in exactly one of
+// the two tables; lookups try the new table first, new keys always go there.
+//
+// the migrate cursor is kept in dwReserved[0] of the old table, so after a
+// restart loading both tables and calling Grow() again resumes the migration.
+// a value pointer returned from the old table is only valid until the next
+// Hash(key, true) or Migrate() call.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class IncrementalHashTable
+{
+public:
+	typedef HashTable<KeyT, ValueT, HeadT> TableType;
+
+	IncrementalHashTable() :
+		m_MigrateStep(HASHTABLE_MIGRATE_STEP)
+	{
+	}
+
+	IncrementalHashTable(TableType table) :
+		m_Table(table),
+		m_MigrateStep(HASHTABLE_MIGRATE_STEP)
+	{
+	}
+
+	inline bool Success()
+	{
+		return m_Table.Success();
+	}
+
+	inline bool IsMigrating()
+	{
+		return m_OldTable.Success();
+	}
+
+	bool Grow(TableType table)
+	{
+		if(IsMigrating() || !m_Table.Success() || !table.Success())
+			return false;
+
+		m_OldTable = m_Table;
+		m_Table = table;
+		return true;
+	}
+
+	// moves up to count nodes, returns the number of nodes left to scan.
+	// 0 means the old table has been released and the migration is over.
+	uint32_t Migrate(uint32_t count)
+	{
+		if(!IsMigrating())
+			return 0;
+
+		HashTableMetaInfo<HeadT>* pOldMetaInfo = m_OldTable.m_TableMetaInfo;
+		uint32_t cursor = pOldMetaInfo->dwReserved[0];
+		uint32_t end = pOldMetaInfo->dwTotal;
+		if(count < end - cursor)
+			end = cursor + count;
+
+		for(; cursor<end; ++cursor)
+		{
+			HashNode<KeyT, ValueT, HashNodeHead<KeyT> >* pNode = &m_OldTable.m_NodeBuffer[cursor];
+			if(pNode->Key.KeyValue == 0)
+				continue;
+
+			// the new table is full, keep the node where it is
+			ValueT* pValue = m_Table.HashKeyValue(pNode->Key.KeyValue, true);
+			if(pValue == NULL)
+				break;
+
+			memcpy(pValue, &pNode->Value, sizeof(ValueT));
+			pNode->Key.KeyValue = 0;
+			memset(&pNode->Value, 0, sizeof(ValueT));
+			m_OldTable.Vacate(cursor);
+			--pOldMetaInfo->dwUsed;
+		}
+		pOldMetaInfo->dwReserved[0] = cursor;
+
+		uint32_t left = pOldMetaInfo->dwTotal - cursor;
+		if(left == 0)
+			m_OldTable.Delete();
+		return left;
+	}
+
+	ValueT* Hash(KeyT key, bool bNew = false)
+	{
+		if(!m_Table.Success())
+			return NULL;
+
+		if(!IsMigrating())
+			return m_Table.Hash(key, bNew);
+
+		if(bNew)
+			Migrate(m_MigrateStep);
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		ValueT* pValue = m_Table.HashKeyValue(headKey, false);
+		if(pValue == NULL && IsMigrating())
+			pValue = m_OldTable.HashKeyValue(headKey, false);
+		if(pValue == NULL && bNew)
+			pValue = m_Table.HashKeyValue(headKey, true);
+		return pValue;
+	}
+
+	void Clear(KeyT key)
+	{
+		m_Table.Clear(key);
+		if(IsMigrating())
+			m_OldTable.Clear(key);
+	}
+
+	float Capacity()
+	{
+		if(!m_Table.Success())
+			return 1;
+
+		uint32_t used = m_Table.m_TableMetaInfo->dwUsed;
+		if(IsMigrating())
+			used += m_OldTable.m_TableMetaInfo->dwUsed;
+		return (float)used / m_Table.m_TableMetaInfo->dwTotal;
+	}
+
+	inline uint32_t GetMigrateStep()
+	{
+		return m_MigrateStep;
+	}
+
+	inline uint32_t SetMigrateStep(uint32_t step)
+	{
+		uint32_t old = m_MigrateStep;
+		m_MigrateStep = step;
+		return old;
+	}
+
+	inline TableType& GetTable()
+	{
+		return m_Table;
+	}
+
+	inline TableType& GetOldTable()
+	{
+		return m_OldTable;
+	}
+
+	void Delete()
+	{
+		m_Table.Delete();
+		m_OldTable.Delete();
+	}
+
+protected:
+	TableType m_Table;
+	TableType m_OldTable;
+
+	uint32_t m_MigrateStep;
+};
+
+#endif // define __INCREMENTALHASHTABLE_HPP__
+
@@ -0,0 +1,506 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.04.28
+ *
+*--*/
+#ifndef __PERFECTHASHTABLE_HPP__
+#define __PERFECTHASHTABLE_HPP__
+
+#include <utility>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+
+#define PERFECTHASHTABLE_MAGIC		"PERFHASH"
+#define PERFECTHASHTABLE_VERSION	0x0101
+
+// average keys per bucket, more is a smaller pilot array and a slower build
+#ifndef PERFECTHASHTABLE_BUCKET_SIZE
+	#define PERFECTHASHTABLE_BUCKET_SIZE	4
+#endif
+
+// pilots tried for one bucket, and hash seeds tried, before a build fails
+#ifndef PERFECTHASHTABLE_PILOT_MAX
+	#define PERFECTHASHTABLE_PILOT_MAX		(1 << 24)
+#endif
+#ifndef PERFECTHASHTABLE_BUILD_RETRY
+	#define PERFECTHASHTABLE_BUILD_RETRY	8
+#endif
+
+template<typename HeadT>
+struct PerfectHashTableMetaInfo {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint32_t dwHeadSize;
+    uint64_t ddwMemSize;
+
+    uint32_t dwCount;
+    uint32_t dwBucketCount;
+    uint64_t ddwSeed;
+
+    uint32_t dwReserved[4];
+
+    HeadT stHead;
+} __attribute__((packed));
+template<>
+struct PerfectHashTableMetaInfo<void> {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint32_t dwHeadSize;
+    uint64_t ddwMemSize;
+
+    uint32_t dwCount;
+    uint32_t dwBucketCount;
+    uint64_t ddwSeed;
+
+    uint32_t dwReserved[4];
+} __attribute__((packed));
+
+// key -> bucket -> position of a PTHash style minimal perfect hash: 60% of
+// the keys go to the first 30% of the buckets, so the large buckets are
+// placed first while most positions are still free, and the pilot of the
+// bucket remixes the hash of its keys until they land on free positions.
+struct PerfectHashFunction
+{
+	uint32_t Count;
+	uint32_t BucketCount;
+	uint32_t DenseCount;
+	uint64_t Seed;
+	FastModulo PositionModulo;
+
+	void Initialize(uint32_t count, uint32_t bucketCount, uint64_t seed)
+	{
+		Count = count;
+		BucketCount = bucketCount;
+		DenseCount = bucketCount * 3 / 10;
+		if(DenseCount == 0 || DenseCount == bucketCount)
+			DenseCount = bucketCount;
+		Seed = seed;
+		if(count > 1)
+			PositionModulo.Initialize(count);
+	}
+
+	template<typename HeadType>
+	inline uint64_t Hash(HeadType headKey) const
+	{
+		return MixRowKey(HashRowKey(headKey) ^ Seed, 0);
+	}
+
+	inline uint32_t Bucket(uint64_t hash) const
+	{
+		uint64_t low = (uint32_t)hash;
+		if(DenseCount == BucketCount)
+			return (low * BucketCount) >> 32;
+		if((hash >> 32) < 0x99999999ULL)
+			return (low * DenseCount) >> 32;
+		return DenseCount + ((low * (BucketCount - DenseCount)) >> 32);
+	}
+
+	inline uint32_t Position(uint64_t hash, uint32_t pilot) const
+	{
+		if(Count <= 1)
+			return 0;
+		return PositionModulo.Mod(MixRowKey(hash, pilot));
+	}
+};
+
+// read-only table of a fixed key set, built offline by a
+// PerfectHashTableBuilder: every key has its own node, so a lookup is one
+// hash, one pilot and one node read, and the table has no empty nodes. A
+// key outside the set lands on some other key's node and is told apart by
+// the stored KeyValue. The buffer holds the head, one uint32_t pilot per
+// bucket and then the nodes.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class PerfectHashTable
+{
+public:
+	typedef HashNode<KeyT, ValueT, HashNodeHead<KeyT> > NodeType;
+
+	template<typename BuilderT>
+	static PerfectHashTable<KeyT, ValueT, HeadT> CreateHashTable(BuilderT& builder)
+	{
+		PerfectHashTable<KeyT, ValueT, HeadT> ht;
+
+		size_t bufferSize = builder.GetBufferSize();
+		char* buffer = (char*)malloc(bufferSize);
+		if(!buffer)
+			return ht;
+
+		if(!builder.Build(buffer, bufferSize) || !ht.Initialize(buffer, bufferSize))
+		{
+			free(buffer);
+			return ht;
+		}
+		ht.m_NeedDelete = true;
+		return ht;
+	}
+
+	static PerfectHashTable<KeyT, ValueT, HeadT> LoadHashTable(char* buffer, size_t size)
+	{
+		PerfectHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(buffer, size);
+		return ht;
+	}
+
+	template<typename StorageT>
+	static PerfectHashTable<KeyT, ValueT, HeadT> LoadHashTable(StorageT storage)
+	{
+		PerfectHashTable<KeyT, ValueT, HeadT> ht;
+		ht.Initialize(storage.GetStorageBuffer(), storage.GetSize());
+		return ht;
+	}
+
+	static inline uint32_t GetBucketCount(uint32_t count)
+	{
+		return count / PERFECTHASHTABLE_BUCKET_SIZE + 1;
+	}
+
+	static inline size_t GetBufferSize(uint32_t count)
+	{
+		return sizeof(PerfectHashTableMetaInfo<HeadT>) + GetBucketCount(count) * sizeof(uint32_t) + count * sizeof(NodeType);
+	}
+
+	static inline size_t GetNodeSize()
+	{
+		return sizeof(NodeType);
+	}
+
+	bool Initialize(char* buffer, size_t size)
+	{
+		if(!buffer || size < sizeof(PerfectHashTableMetaInfo<HeadT>))
+			return false;
+
+		PerfectHashTableMetaInfo<HeadT>* pMetaInfo = (PerfectHashTableMetaInfo<HeadT>*)buffer;
+		if(memcmp(pMetaInfo->cMagic, PERFECTHASHTABLE_MAGIC, 8) != 0 ||
+			pMetaInfo->wVersion != PERFECTHASHTABLE_VERSION ||
+			pMetaInfo->dwHeadSize != sizeof(PerfectHashTableMetaInfo<HeadT>) ||
+			pMetaInfo->dwBucketCount != GetBucketCount(pMetaInfo->dwCount) ||
+			pMetaInfo->ddwMemSize != size ||
+			size != GetBufferSize(pMetaInfo->dwCount))
+			return false;
+
+		m_TableMetaInfo = pMetaInfo;
+		m_Pilot = (uint32_t*)(buffer + pMetaInfo->dwHeadSize);
+		m_NodeBuffer = (NodeType*)(m_Pilot + pMetaInfo->dwBucketCount);
+		m_Function.Initialize(pMetaInfo->dwCount, pMetaInfo->dwBucketCount, pMetaInfo->ddwSeed);
+		return true;
+	}
+
+	inline bool Success()
+	{
+		return m_TableMetaInfo != NULL && m_NodeBuffer != NULL;
+	}
+
+	inline HeadT* GetHead()
+	{
+		if(!m_TableMetaInfo)
+			return NULL;
+		return &m_TableMetaInfo->stHead;
+	}
+
+	ValueT* Hash(KeyT key)
+	{
+		if(!m_TableMetaInfo || !m_NodeBuffer || m_TableMetaInfo->dwCount == 0)
+			return NULL;
+
+		typename KeyTranslate<KeyT>::HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		uint64_t hash = m_Function.Hash(headKey);
+		NodeType* pNode = &m_NodeBuffer[m_Function.Position(hash, m_Pilot[m_Function.Bucket(hash)])];
+		if(pNode->Key.KeyValue != headKey)
+			return NULL;
+		return &pNode->Value;
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator)
+	{
+		return Next(pstIterator, NULL);
+	}
+
+	ValueT* Next(HashTableIterator* pstIterator, typename KeyTranslate<KeyT>::HeadType* pKeyValue)
+	{
+		if(!pstIterator || !m_TableMetaInfo || !m_NodeBuffer || pstIterator->Seed >= m_TableMetaInfo->dwCount)
+			return NULL;
+
+		NodeType* pNode = &m_NodeBuffer[pstIterator->Seed++];
+		if(pKeyValue)
+			*pKeyValue = pNode->Key.KeyValue;
+		return &pNode->Value;
+	}
+
+	inline uint32_t GetCount()
+	{
+		if(!m_TableMetaInfo)
+			return 0;
+		return m_TableMetaInfo->dwCount;
+	}
+
+	float Capacity()
+	{
+		return 1;
+	}
+
+	void Dump()
+	{
+		HexDump((char*)m_TableMetaInfo, m_TableMetaInfo->ddwMemSize, NULL);
+	}
+
+	void Delete()
+	{
+		if(m_NeedDelete && m_TableMetaInfo)
+			free(m_TableMetaInfo);
+
+		m_TableMetaInfo = NULL;
+		m_Pilot = NULL;
+		m_NodeBuffer = NULL;
+	}
+
+	PerfectHashTable() :
+		m_NeedDelete(false),
+		m_TableMetaInfo(NULL),
+		m_Pilot(NULL),
+		m_NodeBuffer(NULL)
+	{
+	}
+
+protected:
+	bool m_NeedDelete;
+
+	PerfectHashTableMetaInfo<HeadT>* m_TableMetaInfo;
+	uint32_t* m_Pilot;
+	NodeType* m_NodeBuffer;
+	PerfectHashFunction m_Function;
+};
+
+// collects key/value pairs, from a HashTable snapshot or one by one, and
+// writes the PerfectHashTable of them into a buffer of GetBufferSize()
+// bytes. A key appended twice keeps its last value.
+template<typename KeyT, typename ValueT, typename HeadT = void>
+class PerfectHashTableBuilder
+{
+public:
+	typedef PerfectHashTable<KeyT, ValueT, HeadT> TableType;
+	typedef typename KeyTranslate<KeyT>::HeadType HeadType;
+	typedef typename TableType::NodeType NodeType;
+
+	void Append(KeyT key, const ValueT& value)
+	{
+		AppendKeyValue(KeyTranslate<KeyT>::Translate(key), value);
+	}
+
+	void AppendKeyValue(HeadType keyValue, const ValueT& value)
+	{
+		if(keyValue == 0)
+			return;
+
+		NodeType node;
+		node.Key.KeyValue = keyValue;
+		memcpy(&node.Value, &value, sizeof(ValueT));
+		m_Nodes.push_back(node);
+		m_Sorted = false;
+	}
+
+	// every node of any HashTable variant with the same value type
+	template<typename HashTableT>
+	void Append(HashTableT& ht)
+	{
+		HashTableIterator iter;
+		HeadType keyValue = 0;
+		ValueT* pValue = NULL;
+		while((pValue = ht.Next(&iter, &keyValue)) != NULL)
+			AppendKeyValue(keyValue, *pValue);
+	}
+
+	inline size_t GetCount()
+	{
+		Unique();
+		return m_Nodes.size();
+	}
+
+	inline size_t GetBufferSize()
+	{
+		return TableType::GetBufferSize(GetCount());
+	}
+
+	bool Build(char* buffer, size_t size)
+	{
+		if(!buffer || size != GetBufferSize())
+			return false;
+
+		uint32_t count = m_Nodes.size();
+		uint32_t bucketCount = TableType::GetBucketCount(count);
+
+		PerfectHashTableMetaInfo<HeadT>* pMetaInfo = (PerfectHashTableMetaInfo<HeadT>*)buffer;
+		uint32_t* pPilot = (uint32_t*)(buffer + sizeof(PerfectHashTableMetaInfo<HeadT>));
+		NodeType* pNodeBuffer = (NodeType*)(pPilot + bucketCount);
+
+		std::vector<uint32_t> vPosition(count);
+		for(uint64_t seed=0; seed<PERFECTHASHTABLE_BUILD_RETRY; ++seed)
+		{
+			PerfectHashFunction function;
+			function.Initialize(count, bucketCount, seed);
+			if(!Search(function, pPilot, &vPosition))
+				continue;
+
+			memset(pMetaInfo, 0, sizeof(PerfectHashTableMetaInfo<HeadT>));
+			memcpy(pMetaInfo->cMagic, PERFECTHASHTABLE_MAGIC, 8);
+			pMetaInfo->wVersion = PERFECTHASHTABLE_VERSION;
+			pMetaInfo->dwHeadSize = sizeof(PerfectHashTableMetaInfo<HeadT>);
+			pMetaInfo->ddwMemSize = size;
+			pMetaInfo->dwCount = count;
+			pMetaInfo->dwBucketCount = bucketCount;
+			pMetaInfo->ddwSeed = seed;
+
+			for(uint32_t i=0; i<count; ++i)
+				memcpy(&pNodeBuffer[vPosition[i]], &m_Nodes[i], sizeof(NodeType));
+			return true;
+		}
+		return false;
+	}
+
+	template<typename StorageT>
+	bool Build(StorageT storage)
+	{
+		return Build(storage.GetStorageBuffer(), storage.GetSize());
+	}
+
+	void Clear()
+	{
+		m_Nodes.clear();
+		m_Sorted = true;
+	}
+
+	PerfectHashTableBuilder() :
+		m_Sorted(true)
+	{
+	}
+
+protected:
+	struct NodeLess
+	{
+		bool operator()(const NodeType& n1, const NodeType& n2) const
+		{
+			return n1.Key.KeyValue < n2.Key.KeyValue;
+		}
+	};
+
+	struct NodeEqual
+	{
+		bool operator()(const NodeType& n1, const NodeType& n2) const
+		{
+			return n1.Key.KeyValue == n2.Key.KeyValue;
+		}
+	};
+
+	// drops all but the last appended node of a key
+	void Unique()
+	{
+		if(m_Sorted)
+			return;
+
+		std::reverse(m_Nodes.begin(), m_Nodes.end());
+		std::stable_sort(m_Nodes.begin(), m_Nodes.end(), NodeLess());
+		m_Nodes.erase(std::unique(m_Nodes.begin(), m_Nodes.end(), NodeEqual()), m_Nodes.end());
+		m_Sorted = true;
+	}
+
+	struct BucketEntry
+	{
+		uint32_t dwBucket;
+		uint32_t dwIndex;
+		uint64_t ddwHash;
+	};
+
+	struct BucketLess
+	{
+		bool operator()(const BucketEntry& e1, const BucketEntry& e2) const
+		{
+			return e1.dwBucket < e2.dwBucket;
+		}
+	};
+
+	struct BucketRange
+	{
+		uint32_t dwBegin;
+		uint32_t dwSize;
+
+		bool operator<(const BucketRange& range) const
+		{
+			return dwSize > range.dwSize;
+		}
+	};
+
+	// places the buckets largest first, each at the first pilot that moves
+	// all its keys to free positions
+	bool Search(PerfectHashFunction& function, uint32_t* pPilot, std::vector<uint32_t>* pPosition)
+	{
+		uint32_t count = m_Nodes.size();
+		std::vector<BucketEntry> vEntry(count);
+		for(uint32_t i=0; i<count; ++i)
+		{
+			vEntry[i].ddwHash = function.Hash(m_Nodes[i].Key.KeyValue);
+			vEntry[i].dwBucket = function.Bucket(vEntry[i].ddwHash);
+			vEntry[i].dwIndex = i;
+		}
+		std::sort(vEntry.begin(), vEntry.end(), BucketLess());
+
+		std::vector<BucketRange> vRange;
+		for(uint32_t begin=0; begin<count; )
+		{
+			BucketRange range = { begin, 0 };
+			while(begin + range.dwSize < count && vEntry[begin + range.dwSize].dwBucket == vEntry[begin].dwBucket)
+				++range.dwSize;
+			vRange.push_back(range);
+			begin += range.dwSize;
+		}
+		std::stable_sort(vRange.begin(), vRange.end());
+
+		memset(pPilot, 0, function.BucketCount * sizeof(uint32_t));
+		std::vector<bool> vTaken(count, false);
+		std::vector<uint32_t> vSlot;
+		for(size_t r=0; r<vRange.size(); ++r)
+		{
+			BucketEntry* pEntry = &vEntry[vRange[r].dwBegin];
+			uint32_t size = vRange[r].dwSize;
+
+			uint32_t pilot = 0;
+			for(; pilot<PERFECTHASHTABLE_PILOT_MAX; ++pilot)
+			{
+				vSlot.clear();
+				uint32_t i = 0;
+				for(; i<size; ++i)
+				{
+					uint32_t pos = function.Position(pEntry[i].ddwHash, pilot);
+					if(vTaken[pos] || std::find(vSlot.begin(), vSlot.end(), pos) != vSlot.end())
+						break;
+					vSlot.push_back(pos);
+				}
+				if(i == size)
+					break;
+			}
+			if(pilot == PERFECTHASHTABLE_PILOT_MAX)
+				return false;
+
+			pPilot[pEntry[0].dwBucket] = pilot;
+			for(uint32_t i=0; i<size; ++i)
+			{
+				vTaken[vSlot[i]] = true;
+				(*pPosition)[pEntry[i].dwIndex] = vSlot[i];
+			}
+		}
+		return true;
+	}
+
+	bool m_Sorted;
+	std::vector<NodeType> m_Nodes;
+};
+
+#endif // define __PERFECTHASHTABLE_HPP__
+
@@ -0,0 +1,298 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.05.06
+ *
+*--*/
+#ifndef __RATELIMITER_HPP__
+#define __RATELIMITER_HPP__
+
+#include <utility>
+#include <string>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+#include "hashtable.hpp"
+#include "concurrenthashtable.hpp"
+
+// state of a node being reclaimed, Acquire() waits for it to go away
+#define RATELIMITER_RECLAIM		0xFFFFFFFFFFFFFFFFULL
+
+// token bucket of Burst tokens refilled at Rate tokens per second, kept as
+// the theoretical arrival time of the next token (GCRA): a single
+// microsecond timestamp, so a node is updated with one CAS.
+struct TokenBucketPolicy
+{
+	uint64_t ddwInterval;
+	uint64_t ddwTolerance;
+
+	TokenBucketPolicy(double rate, uint32_t burst)
+	{
+		ddwInterval = (rate > 0)?(uint64_t)(1000000 / rate):0;
+		if(ddwInterval == 0)
+			ddwInterval = 1;
+		ddwTolerance = ddwInterval * burst;
+	}
+
+	inline bool Acquire(uint64_t state, uint64_t now, uint32_t count, uint64_t* pState) const
+	{
+		uint64_t arrival = (state > now)?state:now;
+		arrival += ddwInterval * count;
+		if(arrival - now > ddwTolerance)
+			return false;
+
+		*pState = arrival;
+		return true;
+	}
+
+	inline uint32_t Available(uint64_t state, uint64_t now) const
+	{
+		uint64_t debt = (state > now)?state - now:0;
+		return (ddwTolerance - debt) / ddwInterval;
+	}
+
+	inline bool Idle(uint64_t state, uint64_t now) const
+	{
+		return state <= now;
+	}
+};
+
+// at most Limit per window of Window microseconds, with the count of the
+// previous window weighted by how much of it still overlaps the sliding
+// window. The window index and both counts share one 64 bit state, so
+// Limit is at most 65535.
+struct SlidingWindowPolicy
+{
+	uint64_t ddwWindow;
+	uint32_t dwLimit;
+
+	SlidingWindowPolicy(uint32_t limit, uint64_t window)
+	{
+		ddwWindow = window?window:1;
+		dwLimit = (limit < 0xFFFF)?limit:0xFFFF;
+	}
+
+	inline bool Acquire(uint64_t state, uint64_t now, uint32_t count, uint64_t* pState) const
+	{
+		uint64_t current = 0;
+		uint64_t previous = 0;
+		uint64_t window = Shift(state, now, &current, &previous);
+
+		uint64_t elapsed = now % ddwWindow;
+		uint64_t weighted = previous * (ddwWindow - elapsed) / ddwWindow;
+		if(weighted + current + count > dwLimit)
+			return false;
+
+		*pState = (window << 32) | ((current + count) << 16) | previous;
+		return true;
+	}
+
+	inline uint32_t Available(uint64_t state, uint64_t now) const
+	{
+		uint64_t current = 0;
+		uint64_t previous = 0;
+		Shift(state, now, &current, &previous);
+
+		uint64_t weighted = previous * (ddwWindow - now % ddwWindow) / ddwWindow;
+		if(weighted + current >= dwLimit)
+			return 0;
+		return dwLimit - weighted - current;
+	}
+
+	inline bool Idle(uint64_t state, uint64_t now) const
+	{
+		return (state >> 32) + 1 < (now / ddwWindow & 0xFFFFFFFF);
+	}
+
+	// counts of the window of now and the one before it
+	inline uint64_t Shift(uint64_t state, uint64_t now, uint64_t* pCurrent, uint64_t* pPrevious) const
+	{
+		uint64_t window = now / ddwWindow & 0xFFFFFFFF;
+		uint64_t last = state >> 32;
+		if(state != 0 && last == window)
+		{
+			*pCurrent = (state >> 16) & 0xFFFF;
+			*pPrevious = state & 0xFFFF;
+		}
+		else if(state != 0 && last + 1 == window)
+			*pPrevious = (state >> 16) & 0xFFFF;
+		return window;
+	}
+};
+
+// per key rate limiter whose state lives in an AtomicHashTable, so any
+// number of threads and processes sharing a SharedMemoryStorage or
+// MapStorage can call Acquire(): one probe finds or claims the node of the
+// key, and the policy state is refilled lazily from its timestamp and
+// updated with a CAS. All users of a storage must use the same policy.
+//
+// Nodes of keys that stopped sending are freed by Reclaim(); a key that
+// finds no free node is let through.
+template<typename KeyT, typename PolicyT = TokenBucketPolicy, typename HeadT = void, typename TimeProviderT = MicroSecondTimeProvider>
+class RateLimiter
+{
+public:
+	typedef typename KeyTranslate<KeyT>::HeadType HeadType;
+	typedef AtomicHashTable<HeadType, uint64_t, HeadT> TableType;
+
+	static RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> CreateRateLimiter(Seed& seed, const PolicyT& policy)
+	{
+		RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> limiter(policy);
+		limiter.m_Table = TableType::CreateHashTable(seed);
+		return limiter;
+	}
+
+	static RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> LoadRateLimiter(char* buffer, size_t size, Seed& seed, const PolicyT& policy)
+	{
+		RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> limiter(policy);
+		limiter.m_Table = TableType::LoadHashTable(buffer, size, seed);
+		return limiter;
+	}
+
+	template<typename StorageT>
+	static RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> LoadRateLimiter(StorageT storage, Seed& seed, const PolicyT& policy)
+	{
+		RateLimiter<KeyT, PolicyT, HeadT, TimeProviderT> limiter(policy);
+		limiter.m_Table = TableType::LoadHashTable(storage, seed);
+		return limiter;
+	}
+
+	static inline size_t GetBufferSize(Seed& seed)
+	{
+		return TableType::GetBufferSize(seed);
+	}
+
+	inline bool Success()
+	{
+		return m_Table.Success();
+	}
+
+	inline HeadT* GetHead()
+	{
+		return m_Table.GetHead();
+	}
+
+	inline TableType& GetTable()
+	{
+		return m_Table;
+	}
+
+	inline TimeProviderT& GetTimeProvider()
+	{
+		return m_TimeProvider;
+	}
+
+	inline void SetTimeProvider(const TimeProviderT& provider)
+	{
+		m_TimeProvider = provider;
+	}
+
+	// takes count from the allowance of key, false when it is exceeded
+	bool Acquire(KeyT key, uint32_t count = 1)
+	{
+		return Acquire(key, count, m_TimeProvider.Ticks(m_TimeProvider.Now()));
+	}
+
+	// the same with now in microseconds
+	bool Acquire(KeyT key, uint32_t count, uint64_t now)
+	{
+		if(!m_Table.Success())
+			return true;
+
+		HeadType headKey = KeyTranslate<KeyT>::Translate(key);
+		for(;;)
+		{
+			uint64_t* pState = m_Table.Hash(headKey, true);
+			if(pState == NULL)
+				return true;
+
+			uint64_t state = AtomicLoad(pState);
+			while(state != RATELIMITER_RECLAIM)
+			{
+				uint64_t next = 0;
+				if(!m_Policy.Acquire(state, now, count, &next))
+					return false;
+
+				uint64_t found = AtomicCompareExchange(pState, state, next);
+				if(found == state)
+					return true;
+				state = found;
+			}
+			CPU_RELAX();
+		}
+	}
+
+	// allowance left for key, without taking any
+	uint32_t Available(KeyT key)
+	{
+		return Available(key, m_TimeProvider.Ticks(m_TimeProvider.Now()));
+	}
+
+	uint32_t Available(KeyT key, uint64_t now)
+	{
+		uint64_t state = 0;
+		uint64_t* pState = m_Table.Hash(KeyTranslate<KeyT>::Translate(key));
+		if(pState != NULL)
+			state = AtomicLoad(pState);
+		if(state == RATELIMITER_RECLAIM)
+			state = 0;
+		return m_Policy.Available(state, now);
+	}
+
+	// frees the nodes of keys whose state is back to a full allowance, at
+	// most limit of them. Safe next to Acquire() in other processes, as the
+	// table holds off claims of new keys while it clears a node, though a
+	// request of an idle key racing its reclaim may go uncounted.
+	size_t Reclaim(size_t limit = (size_t)-1)
+	{
+		return Reclaim(limit, m_TimeProvider.Ticks(m_TimeProvider.Now()));
+	}
+
+	size_t Reclaim(size_t limit, uint64_t now)
+	{
+		size_t reclaimed = 0;
+		HashTableIterator iter;
+		typename TableType::NodeType* pNode = NULL;
+		while(reclaimed < limit && (pNode = m_Table.NextNode(&iter)) != NULL)
+		{
+			HeadType keyValue = AtomicLoad(TableType::GetKeyValue(pNode));
+			uint64_t* pState = TableType::GetValue(pNode);
+			uint64_t state = AtomicLoad(pState);
+
+			// a node just claimed (state 0) is left to its key
+			if(keyValue == 0 || state == 0 || state == RATELIMITER_RECLAIM || !m_Policy.Idle(state, now))
+				continue;
+
+			if(AtomicCompareExchange(pState, state, (uint64_t)RATELIMITER_RECLAIM) != state)
+				continue;
+
+			m_Table.Clear(keyValue);
+			++reclaimed;
+		}
+		return reclaimed;
+	}
+
+	float Capacity()
+	{
+		return m_Table.Capacity();
+	}
+
+	void Delete()
+	{
+		m_Table.Delete();
+	}
+
+	RateLimiter(const PolicyT& policy) :
+		m_Policy(policy)
+	{
+	}
+
+protected:
+	PolicyT m_Policy;
+	TimeProviderT m_TimeProvider;
+	TableType m_Table;
+};
+
+#endif // define __RATELIMITER_HPP__
+
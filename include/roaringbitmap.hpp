@@ -0,0 +1,840 @@
+/*++
+ *
+ * nindex library
+ * author: nickeywoo
+ * date: 2014.05.12
+ *
+*--*/
+#ifndef __ROARINGBITMAP_HPP__
+#define __ROARINGBITMAP_HPP__
+
+#include <utility>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "utility.hpp"
+#include "keyutility.hpp"
+#include "storage.hpp"
+
+#define ROARINGBITMAP_MAGIC		"ROARBMAP"
+#define ROARINGBITMAP_VERSION	0x0101
+
+// a container holds the low 16 bits of the keys of one 2^16 chunk as a
+// sorted array, a 65536 bit bitset, or sorted (start, length - 1) runs
+#define ROARING_CONTAINER_ARRAY		1
+#define ROARING_CONTAINER_BITSET	2
+#define ROARING_CONTAINER_RUN		3
+
+// an array of more values is larger than the 8KB bitset
+#define ROARING_ARRAY_MAX			4096
+#define ROARING_BITSET_WORDS		1024
+
+template<typename HeadT>
+struct RoaringBitmapMeta {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint64_t ddwMemSize;
+    uint32_t dwHeadSize;
+
+    uint64_t ddwSeed;
+    uint64_t ddwUsed;
+    uint64_t ddwContainerCount;
+
+    uint32_t dwReserved[4];
+
+    HeadT Head;
+} __attribute__((packed));
+template<>
+struct RoaringBitmapMeta<void> {
+    char cMagic[8];
+    uint16_t wVersion;
+
+    uint64_t ddwMemSize;
+    uint32_t dwHeadSize;
+
+    uint64_t ddwSeed;
+    uint64_t ddwUsed;
+    uint64_t ddwContainerCount;
+
+    uint32_t dwReserved[4];
+} __attribute__((packed));
+
+// one container of a stored bitmap, sorted by key after the meta; the data
+// of a container starts ddwOffset bytes into the buffer, 8 byte aligned
+struct RoaringContainerIndex {
+    uint64_t ddwKey;
+    uint64_t ddwOffset;
+    uint32_t dwCount;
+    uint32_t dwCardinality;
+    uint16_t wType;
+} __attribute__((packed));
+
+// a container wherever it lives: dwCount is the values of an array, the
+// runs of a run container, the words of a bitset
+struct RoaringContainer
+{
+	uint16_t wType;
+	uint32_t dwCount;
+	uint32_t dwCardinality;
+	const uint16_t* pData;
+};
+
+// a container of a bitmap in memory, a bitset is 4096 uint16_t
+struct RoaringChunk
+{
+	uint16_t wType;
+	uint32_t dwCardinality;
+	std::vector<uint16_t> vData;
+
+	RoaringChunk() :
+		wType(ROARING_CONTAINER_ARRAY),
+		dwCardinality(0)
+	{
+	}
+
+	inline uint64_t* GetWords()
+	{
+		return (uint64_t*)&vData[0];
+	}
+
+	inline RoaringContainer GetContainer() const
+	{
+		RoaringContainer container;
+		container.wType = wType;
+		container.dwCount = (wType == ROARING_CONTAINER_BITSET)?ROARING_BITSET_WORDS:
+								((wType == ROARING_CONTAINER_RUN)?vData.size() / 2:vData.size());
+		container.dwCardinality = dwCardinality;
+		container.pData = vData.empty()?NULL:&vData[0];
+		return container;
+	}
+};
+
+inline bool RoaringContains(const RoaringContainer& container, uint16_t value)
+{
+	if(container.wType == ROARING_CONTAINER_BITSET)
+		return (((const uint64_t*)container.pData)[value >> 6] >> (value & 63)) & 1;
+
+	if(container.wType == ROARING_CONTAINER_ARRAY)
+		return std::binary_search(container.pData, container.pData + container.dwCount, value);
+
+	// the last run starting at or before value
+	uint32_t begin = 0;
+	uint32_t end = container.dwCount;
+	while(begin < end)
+	{
+		uint32_t middle = (begin + end) / 2;
+		if(container.pData[middle * 2] <= value)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+	if(begin == 0)
+		return false;
+	const uint16_t* pRun = &container.pData[(begin - 1) * 2];
+	return (uint32_t)value <= (uint32_t)pRun[0] + pRun[1];
+}
+
+// sets the bits first to last of a bitset
+inline void RoaringSetRange(uint64_t* pWords, uint32_t first, uint32_t last)
+{
+	for(uint32_t pos=first; pos<=last; )
+	{
+		uint32_t bit = pos & 63;
+		uint32_t count = std::min(64 - bit, last - pos + 1);
+		pWords[pos >> 6] |= ((count == 64)?~0ULL:((1ULL << count) - 1)) << bit;
+		pos += count;
+	}
+}
+
+inline void RoaringToBitset(const RoaringContainer& container, uint64_t* pWords)
+{
+	if(container.wType == ROARING_CONTAINER_BITSET)
+	{
+		memcpy(pWords, container.pData, ROARING_BITSET_WORDS * sizeof(uint64_t));
+		return;
+	}
+
+	memset(pWords, 0, ROARING_BITSET_WORDS * sizeof(uint64_t));
+	if(container.wType == ROARING_CONTAINER_ARRAY)
+	{
+		for(uint32_t i=0; i<container.dwCount; ++i)
+			pWords[container.pData[i] >> 6] |= 1ULL << (container.pData[i] & 63);
+	}
+	else
+	{
+		for(uint32_t i=0; i<container.dwCount; ++i)
+			RoaringSetRange(pWords, container.pData[i * 2], (uint32_t)container.pData[i * 2] + container.pData[i * 2 + 1]);
+	}
+}
+
+inline uint32_t RoaringRunCount(const RoaringContainer& container)
+{
+	if(container.wType == ROARING_CONTAINER_RUN)
+		return container.dwCount;
+
+	uint32_t runs = 0;
+	if(container.wType == ROARING_CONTAINER_ARRAY)
+	{
+		for(uint32_t i=0; i<container.dwCount; ++i)
+		{
+			if(i == 0 || container.pData[i] != container.pData[i - 1] + 1)
+				++runs;
+		}
+		return runs;
+	}
+
+	// a run starts at every set bit whose lower neighbour is clear
+	const uint64_t* pWords = (const uint64_t*)container.pData;
+	uint64_t carry = 0;
+	for(uint32_t i=0; i<ROARING_BITSET_WORDS; ++i)
+	{
+		runs += __builtin_popcountll(pWords[i] & ~(pWords[i] << 1 | carry));
+		carry = pWords[i] >> 63;
+	}
+	return runs;
+}
+
+// rebuilds chunk as wType from a bitset of cardinality bits
+inline void RoaringFromBitset(const uint64_t* pWords, uint32_t cardinality, uint16_t wType, RoaringChunk* pChunk)
+{
+	pChunk->wType = wType;
+	pChunk->dwCardinality = cardinality;
+	pChunk->vData.clear();
+
+	if(wType == ROARING_CONTAINER_BITSET)
+	{
+		pChunk->vData.resize(ROARING_BITSET_WORDS * 4);
+		memcpy(pChunk->GetWords(), pWords, ROARING_BITSET_WORDS * sizeof(uint64_t));
+	}
+	else if(wType == ROARING_CONTAINER_ARRAY)
+	{
+		pChunk->vData.reserve(cardinality);
+		for(uint32_t i=0; i<ROARING_BITSET_WORDS; ++i)
+		{
+			for(uint64_t word = pWords[i]; word; word &= word - 1)
+				pChunk->vData.push_back(i * 64 + __builtin_ctzll(word));
+		}
+	}
+	else
+	{
+		uint32_t i = 0;
+		uint64_t word = pWords[0];
+		for(;;)
+		{
+			while(word == 0 && i + 1 < ROARING_BITSET_WORDS)
+				word = pWords[++i];
+			if(word == 0)
+				break;
+
+			uint32_t start = i * 64 + __builtin_ctzll(word);
+			// ones from start on, then look for the first zero after them
+			word |= word - 1;
+			while(word == ~0ULL && i + 1 < ROARING_BITSET_WORDS)
+				word = pWords[++i];
+
+			uint32_t end = (word == ~0ULL)?65536:i * 64 + __builtin_ctzll(~word);
+			pChunk->vData.push_back(start);
+			pChunk->vData.push_back(end - start - 1);
+			if(end == 65536)
+				break;
+			word &= word + 1;
+		}
+	}
+}
+
+// smallest of array, bitset and runs for the same values
+inline void RoaringOptimize(RoaringChunk* pChunk)
+{
+	RoaringContainer container = pChunk->GetContainer();
+	uint64_t runSize = RoaringRunCount(container) * 4;
+	uint64_t arraySize = (pChunk->dwCardinality <= ROARING_ARRAY_MAX)?pChunk->dwCardinality * 2:(uint64_t)-1;
+	uint64_t bitsetSize = ROARING_BITSET_WORDS * sizeof(uint64_t);
+
+	uint16_t wType = ROARING_CONTAINER_ARRAY;
+	if(bitsetSize < arraySize && bitsetSize <= runSize)
+		wType = ROARING_CONTAINER_BITSET;
+	if(runSize < arraySize && runSize < bitsetSize)
+		wType = ROARING_CONTAINER_RUN;
+	if(wType == pChunk->wType)
+		return;
+
+	std::vector<uint64_t> vWords(ROARING_BITSET_WORDS);
+	RoaringToBitset(container, &vWords[0]);
+	RoaringFromBitset(&vWords[0], pChunk->dwCardinality, wType, pChunk);
+}
+
+// an array, or a bitset once an array would be larger
+inline void RoaringFromWords(const uint64_t* pWords, RoaringChunk* pChunk)
+{
+	uint32_t cardinality = 0;
+	for(uint32_t i=0; i<ROARING_BITSET_WORDS; ++i)
+		cardinality += __builtin_popcountll(pWords[i]);
+	RoaringFromBitset(pWords, cardinality, (cardinality <= ROARING_ARRAY_MAX)?ROARING_CONTAINER_ARRAY:ROARING_CONTAINER_BITSET, pChunk);
+}
+
+inline void RoaringAnd(const RoaringContainer& c1, const RoaringContainer& c2, RoaringChunk* pChunk)
+{
+	pChunk->wType = ROARING_CONTAINER_ARRAY;
+	pChunk->vData.clear();
+	if(c1.wType == ROARING_CONTAINER_ARRAY && c2.wType == ROARING_CONTAINER_ARRAY)
+	{
+		pChunk->vData.resize(std::min(c1.dwCount, c2.dwCount));
+		pChunk->vData.resize(std::set_intersection(c1.pData, c1.pData + c1.dwCount,
+									c2.pData, c2.pData + c2.dwCount, pChunk->vData.begin()) - pChunk->vData.begin());
+	}
+	else if(c1.wType == ROARING_CONTAINER_ARRAY || c2.wType == ROARING_CONTAINER_ARRAY)
+	{
+		const RoaringContainer& array = (c1.wType == ROARING_CONTAINER_ARRAY)?c1:c2;
+		const RoaringContainer& other = (c1.wType == ROARING_CONTAINER_ARRAY)?c2:c1;
+		for(uint32_t i=0; i<array.dwCount; ++i)
+		{
+			if(RoaringContains(other, array.pData[i]))
+				pChunk->vData.push_back(array.pData[i]);
+		}
+	}
+	else
+	{
+		std::vector<uint64_t> vWords1(ROARING_BITSET_WORDS);
+		std::vector<uint64_t> vWords2(ROARING_BITSET_WORDS);
+		RoaringToBitset(c1, &vWords1[0]);
+		RoaringToBitset(c2, &vWords2[0]);
+		for(uint32_t i=0; i<ROARING_BITSET_WORDS; ++i)
+			vWords1[i] &= vWords2[i];
+		RoaringFromWords(&vWords1[0], pChunk);
+		return;
+	}
+	pChunk->dwCardinality = pChunk->vData.size();
+}
+
+inline void RoaringOr(const RoaringContainer& c1, const RoaringContainer& c2, RoaringChunk* pChunk)
+{
+	pChunk->vData.clear();
+	if(c1.wType == ROARING_CONTAINER_ARRAY && c2.wType == ROARING_CONTAINER_ARRAY &&
+		c1.dwCount + c2.dwCount <= ROARING_ARRAY_MAX)
+	{
+		pChunk->wType = ROARING_CONTAINER_ARRAY;
+		pChunk->vData.resize(c1.dwCount + c2.dwCount);
+		pChunk->vData.resize(std::set_union(c1.pData, c1.pData + c1.dwCount,
+									c2.pData, c2.pData + c2.dwCount, pChunk->vData.begin()) - pChunk->vData.begin());
+		pChunk->dwCardinality = pChunk->vData.size();
+		return;
+	}
+
+	std::vector<uint64_t> vWords1(ROARING_BITSET_WORDS);
+	std::vector<uint64_t> vWords2(ROARING_BITSET_WORDS);
+	RoaringToBitset(c1, &vWords1[0]);
+	RoaringToBitset(c2, &vWords2[0]);
+	for(uint32_t i=0; i<ROARING_BITSET_WORDS; ++i)
+		vWords1[i] |= vWords2[i];
+	RoaringFromWords(&vWords1[0], pChunk);
+}
+
+// compressed sibling of Bitmap for sparse sets: the key space is split in
+// chunks of 2^16 keys, and only the chunks holding keys have a container,
+// each an array, a bitset or runs, whichever is smallest.
+//
+// Set()/Unset() work on containers in memory. Store() writes the bitmap
+// into a buffer (a MapStorage or FileStorage), and LoadBitmap() queries
+// such a buffer in place: Contains() is a binary search of the container
+// index and one container lookup, nothing is read up front. The first
+// Set()/Unset()/And()/Or() on a loaded bitmap copies it into memory; Store()
+// it again to keep the changes.
+template<typename KeyT, typename HeadT = void>
+class RoaringBitmap
+{
+public:
+	typedef std::map<uint64_t, RoaringChunk> ChunkMap;
+
+	static RoaringBitmap<KeyT, HeadT> CreateBitmap(uint64_t bitCount)
+	{
+		RoaringBitmap<KeyT, HeadT> bitmap;
+		if(bitCount == 0)
+			return bitmap;
+
+		memcpy(bitmap.m_MetaInfo.cMagic, ROARINGBITMAP_MAGIC, 8);
+		bitmap.m_MetaInfo.wVersion = ROARINGBITMAP_VERSION;
+		bitmap.m_MetaInfo.dwHeadSize = sizeof(RoaringBitmapMeta<HeadT>);
+		bitmap.m_MetaInfo.ddwSeed = bitCount;
+		bitmap.m_Success = true;
+		return bitmap;
+	}
+
+	static RoaringBitmap<KeyT, HeadT> LoadBitmap(char* buffer, size_t size)
+	{
+		RoaringBitmap<KeyT, HeadT> bitmap;
+		if(!buffer || size < sizeof(RoaringBitmapMeta<HeadT>))
+			return bitmap;
+
+		RoaringBitmapMeta<HeadT>* pMetaInfo = (RoaringBitmapMeta<HeadT>*)buffer;
+		if(memcmp(pMetaInfo->cMagic, ROARINGBITMAP_MAGIC, 8) != 0 ||
+			pMetaInfo->wVersion != ROARINGBITMAP_VERSION ||
+			pMetaInfo->ddwMemSize != size ||
+			pMetaInfo->dwHeadSize != sizeof(RoaringBitmapMeta<HeadT>) ||
+			pMetaInfo->ddwSeed == 0 ||
+			pMetaInfo->ddwContainerCount > (size - sizeof(RoaringBitmapMeta<HeadT>)) / sizeof(RoaringContainerIndex))
+			return bitmap;
+
+		RoaringContainerIndex* pIndex = (RoaringContainerIndex*)(buffer + sizeof(RoaringBitmapMeta<HeadT>));
+		for(uint64_t i=0; i<pMetaInfo->ddwContainerCount; ++i)
+		{
+			if(pIndex[i].ddwOffset % 8 != 0 || pIndex[i].ddwOffset > size ||
+				GetDataSize(pIndex[i].wType, pIndex[i].dwCount) > size - pIndex[i].ddwOffset)
+				return bitmap;
+		}
+
+		bitmap.m_pLoadMetaInfo = pMetaInfo;
+		bitmap.m_pIndex = pIndex;
+		bitmap.m_Buffer = buffer;
+		bitmap.m_Success = true;
+		return bitmap;
+	}
+
+	template<typename StorageT>
+	static RoaringBitmap<KeyT, HeadT> LoadBitmap(StorageT storage)
+	{
+		return RoaringBitmap<KeyT, HeadT>::LoadBitmap(storage.GetStorageBuffer(), storage.GetSize());
+	}
+
+	inline bool Success()
+	{
+		return m_Success;
+	}
+
+	HeadT* GetHead()
+	{
+		if(!m_Success)
+			return NULL;
+		return &GetMetaInfo()->Head;
+	}
+
+	inline uint64_t GetBitCount()
+	{
+		return m_Success?GetMetaInfo()->ddwSeed:0;
+	}
+
+	inline uint64_t GetCount()
+	{
+		return m_Success?GetMetaInfo()->ddwUsed:0;
+	}
+
+	inline uint64_t GetContainerCount()
+	{
+		if(!m_Success)
+			return 0;
+		return m_pLoadMetaInfo?m_pLoadMetaInfo->ddwContainerCount:m_Chunks.size();
+	}
+
+	bool Set(KeyT key)
+	{
+		if(!m_Success)
+			return false;
+
+		Unpack();
+		uint64_t hash = KeyTranslate<KeyT>::Translate(key) % m_MetaInfo.ddwSeed;
+		RoaringChunk& chunk = m_Chunks[hash >> 16];
+		bool op = SetChunk(&chunk, hash & 0xFFFF);
+		if(!op)
+			++m_MetaInfo.ddwUsed;
+		return op;
+	}
+
+	bool Unset(KeyT key)
+	{
+		if(!m_Success)
+			return false;
+
+		Unpack();
+		uint64_t hash = KeyTranslate<KeyT>::Translate(key) % m_MetaInfo.ddwSeed;
+		typename ChunkMap::iterator iter = m_Chunks.find(hash >> 16);
+		if(iter == m_Chunks.end())
+			return false;
+
+		bool op = UnsetChunk(&iter->second, hash & 0xFFFF);
+		if(op)
+			--m_MetaInfo.ddwUsed;
+		if(iter->second.dwCardinality == 0)
+			m_Chunks.erase(iter);
+		return op;
+	}
+
+	bool Contains(KeyT key)
+	{
+		if(!m_Success)
+			return false;
+
+		uint64_t hash = KeyTranslate<KeyT>::Translate(key) % GetMetaInfo()->ddwSeed;
+		RoaringContainer container;
+		if(!FindContainer(hash >> 16, &container))
+			return false;
+		return RoaringContains(container, hash & 0xFFFF);
+	}
+
+	float Capacity()
+	{
+		if(!m_Success)
+			return 1;
+		return (float)GetMetaInfo()->ddwUsed / GetMetaInfo()->ddwSeed;
+	}
+
+	// this = this & bitmap, both of the same bit count
+	bool And(RoaringBitmap<KeyT, HeadT>& bitmap)
+	{
+		std::vector<std::pair<uint64_t, RoaringContainer> > v1, v2;
+		if(!Prepare(bitmap, &v1, &v2))
+			return false;
+
+		ChunkMap chunks;
+		uint64_t used = 0;
+		for(size_t i=0, j=0; i<v1.size() && j<v2.size(); )
+		{
+			if(v1[i].first < v2[j].first)
+				++i;
+			else if(v2[j].first < v1[i].first)
+				++j;
+			else
+			{
+				RoaringChunk chunk;
+				RoaringAnd(v1[i].second, v2[j].second, &chunk);
+				if(chunk.dwCardinality)
+					used += Insert(&chunks, v1[i].first, chunk);
+				++i;
+				++j;
+			}
+		}
+		Replace(&chunks, used);
+		return true;
+	}
+
+	// this = this | bitmap, both of the same bit count
+	bool Or(RoaringBitmap<KeyT, HeadT>& bitmap)
+	{
+		std::vector<std::pair<uint64_t, RoaringContainer> > v1, v2;
+		if(!Prepare(bitmap, &v1, &v2))
+			return false;
+
+		ChunkMap chunks;
+		uint64_t used = 0;
+		for(size_t i=0, j=0; i<v1.size() || j<v2.size(); )
+		{
+			RoaringChunk chunk;
+			uint64_t key = 0;
+			if(j == v2.size() || (i < v1.size() && v1[i].first < v2[j].first))
+			{
+				key = v1[i].first;
+				Copy(v1[i++].second, &chunk);
+			}
+			else if(i == v1.size() || v2[j].first < v1[i].first)
+			{
+				key = v2[j].first;
+				Copy(v2[j++].second, &chunk);
+			}
+			else
+			{
+				key = v1[i].first;
+				RoaringOr(v1[i++].second, v2[j++].second, &chunk);
+			}
+			used += Insert(&chunks, key, chunk);
+		}
+		Replace(&chunks, used);
+		return true;
+	}
+
+	// turns every container into the smallest of its forms, Store() does it
+	void RunOptimize()
+	{
+		for(typename ChunkMap::iterator iter=m_Chunks.begin(); iter!=m_Chunks.end(); ++iter)
+			RoaringOptimize(&iter->second);
+	}
+
+	// size of the buffer Store() writes
+	size_t GetBufferSize()
+	{
+		if(!m_Success)
+			return 0;
+		if(m_pLoadMetaInfo)
+			return m_pLoadMetaInfo->ddwMemSize;
+
+		RunOptimize();
+		size_t size = GetDataOffset(m_Chunks.size());
+		for(typename ChunkMap::iterator iter=m_Chunks.begin(); iter!=m_Chunks.end(); ++iter)
+		{
+			RoaringContainer container = iter->second.GetContainer();
+			size += (GetDataSize(container.wType, container.dwCount) + 7) & ~(size_t)7;
+		}
+		return size;
+	}
+
+	bool Store(char* buffer, size_t size)
+	{
+		if(!m_Success || !buffer || size != GetBufferSize())
+			return false;
+
+		if(m_pLoadMetaInfo)
+		{
+			if(buffer != m_Buffer)
+				memmove(buffer, m_Buffer, size);
+			return true;
+		}
+
+		memset(buffer, 0, size);
+		RoaringBitmapMeta<HeadT>* pMetaInfo = (RoaringBitmapMeta<HeadT>*)buffer;
+		memcpy(pMetaInfo, &m_MetaInfo, sizeof(RoaringBitmapMeta<HeadT>));
+		pMetaInfo->ddwMemSize = size;
+		pMetaInfo->ddwContainerCount = m_Chunks.size();
+
+		RoaringContainerIndex* pIndex = (RoaringContainerIndex*)(buffer + sizeof(RoaringBitmapMeta<HeadT>));
+		size_t offset = GetDataOffset(m_Chunks.size());
+		for(typename ChunkMap::iterator iter=m_Chunks.begin(); iter!=m_Chunks.end(); ++iter, ++pIndex)
+		{
+			RoaringContainer container = iter->second.GetContainer();
+			size_t dataSize = GetDataSize(container.wType, container.dwCount);
+
+			pIndex->ddwKey = iter->first;
+			pIndex->ddwOffset = offset;
+			pIndex->dwCount = container.dwCount;
+			pIndex->dwCardinality = container.dwCardinality;
+			pIndex->wType = container.wType;
+
+			memcpy(buffer + offset, container.pData, dataSize);
+			offset += (dataSize + 7) & ~(size_t)7;
+		}
+		return true;
+	}
+
+	template<typename StorageT>
+	bool Store(StorageT storage)
+	{
+		return Store(storage.GetStorageBuffer(), storage.GetSize());
+	}
+
+	void Delete()
+	{
+		m_Chunks.clear();
+		m_pLoadMetaInfo = NULL;
+		m_pIndex = NULL;
+		m_Buffer = NULL;
+		m_Success = false;
+	}
+
+	RoaringBitmap() :
+		m_Success(false),
+		m_pLoadMetaInfo(NULL),
+		m_pIndex(NULL),
+		m_Buffer(NULL)
+	{
+		memset(&m_MetaInfo, 0, sizeof(RoaringBitmapMeta<HeadT>));
+	}
+
+protected:
+	static inline size_t GetDataSize(uint16_t wType, uint32_t count)
+	{
+		if(wType == ROARING_CONTAINER_BITSET)
+			return ROARING_BITSET_WORDS * sizeof(uint64_t);
+		if(wType == ROARING_CONTAINER_RUN)
+			return count * 2 * sizeof(uint16_t);
+		return count * sizeof(uint16_t);
+	}
+
+	static inline size_t GetDataOffset(size_t containerCount)
+	{
+		return (sizeof(RoaringBitmapMeta<HeadT>) + containerCount * sizeof(RoaringContainerIndex) + 7) & ~(size_t)7;
+	}
+
+	inline RoaringBitmapMeta<HeadT>* GetMetaInfo()
+	{
+		return m_pLoadMetaInfo?m_pLoadMetaInfo:&m_MetaInfo;
+	}
+
+	inline RoaringContainer GetContainer(RoaringContainerIndex* pIndex)
+	{
+		RoaringContainer container;
+		container.wType = pIndex->wType;
+		container.dwCount = pIndex->dwCount;
+		container.dwCardinality = pIndex->dwCardinality;
+		container.pData = (const uint16_t*)(m_Buffer + pIndex->ddwOffset);
+		return container;
+	}
+
+	bool FindContainer(uint64_t key, RoaringContainer* pContainer)
+	{
+		if(!m_pLoadMetaInfo)
+		{
+			typename ChunkMap::iterator iter = m_Chunks.find(key);
+			if(iter == m_Chunks.end())
+				return false;
+			*pContainer = iter->second.GetContainer();
+			return true;
+		}
+
+		uint64_t begin = 0;
+		uint64_t end = m_pLoadMetaInfo->ddwContainerCount;
+		while(begin < end)
+		{
+			uint64_t middle = (begin + end) / 2;
+			if(m_pIndex[middle].ddwKey < key)
+				begin = middle + 1;
+			else
+				end = middle;
+		}
+		if(begin == m_pLoadMetaInfo->ddwContainerCount || m_pIndex[begin].ddwKey != key)
+			return false;
+		*pContainer = GetContainer(&m_pIndex[begin]);
+		return true;
+	}
+
+	// copies a loaded bitmap into memory before it changes
+	void Unpack()
+	{
+		if(!m_pLoadMetaInfo)
+			return;
+
+		memcpy(&m_MetaInfo, m_pLoadMetaInfo, sizeof(RoaringBitmapMeta<HeadT>));
+		m_Chunks.clear();
+		for(uint64_t i=0; i<m_pLoadMetaInfo->ddwContainerCount; ++i)
+			Copy(GetContainer(&m_pIndex[i]), &m_Chunks[(uint64_t)m_pIndex[i].ddwKey]);
+
+		m_pLoadMetaInfo = NULL;
+		m_pIndex = NULL;
+		m_Buffer = NULL;
+	}
+
+	void GetContainers(std::vector<std::pair<uint64_t, RoaringContainer> >* pContainers)
+	{
+		if(m_pLoadMetaInfo)
+		{
+			pContainers->reserve(m_pLoadMetaInfo->ddwContainerCount);
+			for(uint64_t i=0; i<m_pLoadMetaInfo->ddwContainerCount; ++i)
+				pContainers->push_back(std::make_pair((uint64_t)m_pIndex[i].ddwKey, GetContainer(&m_pIndex[i])));
+			return;
+		}
+
+		pContainers->reserve(m_Chunks.size());
+		for(typename ChunkMap::iterator iter=m_Chunks.begin(); iter!=m_Chunks.end(); ++iter)
+			pContainers->push_back(std::make_pair(iter->first, iter->second.GetContainer()));
+	}
+
+	bool Prepare(RoaringBitmap<KeyT, HeadT>& bitmap, std::vector<std::pair<uint64_t, RoaringContainer> >* pContainers1,
+					std::vector<std::pair<uint64_t, RoaringContainer> >* pContainers2)
+	{
+		if(!m_Success || !bitmap.m_Success || GetBitCount() != bitmap.GetBitCount())
+			return false;
+
+		GetContainers(pContainers1);
+		bitmap.GetContainers(pContainers2);
+		return true;
+	}
+
+	static void Copy(const RoaringContainer& container, RoaringChunk* pChunk)
+	{
+		pChunk->wType = container.wType;
+		pChunk->dwCardinality = container.dwCardinality;
+		pChunk->vData.assign(container.pData, container.pData + GetDataSize(container.wType, container.dwCount) / sizeof(uint16_t));
+	}
+
+	static uint64_t Insert(ChunkMap* pChunks, uint64_t key, RoaringChunk& chunk)
+	{
+		RoaringOptimize(&chunk);
+		RoaringChunk& target = (*pChunks)[key];
+		target.wType = chunk.wType;
+		target.dwCardinality = chunk.dwCardinality;
+		target.vData.swap(chunk.vData);
+		return target.dwCardinality;
+	}
+
+	// the containers of an operation become the bitmap; they may point into
+	// this bitmap or its buffer, so they are all built first
+	void Replace(ChunkMap* pChunks, uint64_t used)
+	{
+		if(m_pLoadMetaInfo)
+			memcpy(&m_MetaInfo, m_pLoadMetaInfo, sizeof(RoaringBitmapMeta<HeadT>));
+		m_pLoadMetaInfo = NULL;
+		m_pIndex = NULL;
+		m_Buffer = NULL;
+
+		m_Chunks.swap(*pChunks);
+		m_MetaInfo.ddwUsed = used;
+	}
+
+	// array or bitset, runs are expanded before they change
+	static void Expand(RoaringChunk* pChunk)
+	{
+		if(pChunk->wType != ROARING_CONTAINER_RUN)
+			return;
+
+		std::vector<uint64_t> vWords(ROARING_BITSET_WORDS);
+		RoaringToBitset(pChunk->GetContainer(), &vWords[0]);
+		RoaringFromBitset(&vWords[0], pChunk->dwCardinality,
+			(pChunk->dwCardinality <= ROARING_ARRAY_MAX)?ROARING_CONTAINER_ARRAY:ROARING_CONTAINER_BITSET, pChunk);
+	}
+
+	static bool SetChunk(RoaringChunk* pChunk, uint16_t value)
+	{
+		Expand(pChunk);
+		if(pChunk->wType == ROARING_CONTAINER_BITSET)
+		{
+			uint64_t* pWord = &pChunk->GetWords()[value >> 6];
+			uint64_t mask = 1ULL << (value & 63);
+			if(*pWord & mask)
+				return true;
+			*pWord |= mask;
+			++pChunk->dwCardinality;
+			return false;
+		}
+
+		std::vector<uint16_t>::iterator iter = std::lower_bound(pChunk->vData.begin(), pChunk->vData.end(), value);
+		if(iter != pChunk->vData.end() && *iter == value)
+			return true;
+		pChunk->vData.insert(iter, value);
+		++pChunk->dwCardinality;
+
+		if(pChunk->dwCardinality > ROARING_ARRAY_MAX)
+		{
+			std::vector<uint64_t> vWords(ROARING_BITSET_WORDS);
+			RoaringToBitset(pChunk->GetContainer(), &vWords[0]);
+			RoaringFromBitset(&vWords[0], pChunk->dwCardinality, ROARING_CONTAINER_BITSET, pChunk);
+		}
+		return false;
+	}
+
+	static bool UnsetChunk(RoaringChunk* pChunk, uint16_t value)
+	{
+		Expand(pChunk);
+		if(pChunk->wType == ROARING_CONTAINER_BITSET)
+		{
+			uint64_t* pWord = &pChunk->GetWords()[value >> 6];
+			uint64_t mask = 1ULL << (value & 63);
+			if(!(*pWord & mask))
+				return false;
+			*pWord &= ~mask;
+			--pChunk->dwCardinality;
+
+			if(pChunk->dwCardinality <= ROARING_ARRAY_MAX)
+			{
+				std::vector<uint64_t> vWords(pChunk->GetWords(), pChunk->GetWords() + ROARING_BITSET_WORDS);
+				RoaringFromBitset(&vWords[0], pChunk->dwCardinality, ROARING_CONTAINER_ARRAY, pChunk);
+			}
+			return true;
+		}
+
+		std::vector<uint16_t>::iterator iter = std::lower_bound(pChunk->vData.begin(), pChunk->vData.end(), value);
+		if(iter == pChunk->vData.end() || *iter != value)
+			return false;
+		pChunk->vData.erase(iter);
+		--pChunk->dwCardinality;
+		return true;
+	}
+
+	bool m_Success;
+
+	RoaringBitmapMeta<HeadT> m_MetaInfo;
+	ChunkMap m_Chunks;
+
+	RoaringBitmapMeta<HeadT>* m_pLoadMetaInfo;
+	RoaringContainerIndex* m_pIndex;
+	char* m_Buffer;
+};
+
+#endif // define __ROARINGBITMAP_HPP__
+
@@ -75,6 +75,17 @@ public:
 	enum { Index = (temp == -1)?-1:(1 + temp) };
 };
 
+template<typename T>
+struct RemoveReference
+{
+	typedef T Type;
+};
+template<typename T>
+struct RemoveReference<T&>
+{
+	typedef T Type;
+};
+
 template<typename T, typename F>
 struct alias_cast_t {
 	union {
@@ -104,6 +115,49 @@ struct StaticSub {
     };
 };
 
+#if defined(__i386__) || defined(__x86_64__)
+	// x86 keeps loads and stores in program order, the compiler must not
+	#define READ_BARRIER()		__asm__ __volatile__("" ::: "memory")
+	#define WRITE_BARRIER()		__asm__ __volatile__("" ::: "memory")
+	#define CPU_RELAX()			__builtin_ia32_pause()
+#else
+	#define READ_BARRIER()		__sync_synchronize()
+	#define WRITE_BARRIER()		__sync_synchronize()
+	#define CPU_RELAX()			__asm__ __volatile__("" ::: "memory")
+#endif
+#define MEMORY_BARRIER()		__sync_synchronize()
+
+template<typename T>
+inline T AtomicLoad(T* ptr)
+{
+	return *(volatile T*)ptr;
+}
+
+template<typename T>
+inline T AtomicFetchAdd(T* ptr, T delta)
+{
+	return __sync_fetch_and_add(ptr, delta);
+}
+
+template<typename T>
+inline T AtomicFetchOr(T* ptr, T mask)
+{
+	return __sync_fetch_and_or(ptr, mask);
+}
+
+template<typename T>
+inline T AtomicFetchAnd(T* ptr, T mask)
+{
+	return __sync_fetch_and_and(ptr, mask);
+}
+
+// returns the value found at ptr, the swap happened if it equals expected
+template<typename T>
+inline T AtomicCompareExchange(T* ptr, T expected, T desired)
+{
+	return __sync_val_compare_and_swap(ptr, expected, desired);
+}
+
 #ifndef ntohll
 	#define ntohll(val)	\
 			((uint64_t)ntohl(0xFFFFFFFF&val) << 32 | ntohl((0xFFFFFFFF00000000&val) >> 32))
@@ -121,9 +175,104 @@ uint128_t MD5_128(const char* ptr, size_t len);
 
 void HexDump(const char* ptr, size_t len, char** out);
 
+bool IsPrime(uint32_t num);
 uint32_t GetPrime(uint32_t num);
 uint32_t GetPrimes(uint32_t num, uint32_t* buffer, uint32_t len);
 
+// largest power of two <= num
+uint32_t GetPowerOfTwo(uint32_t num);
+
+// a row of a power of two size (more than 2 nodes, so never a prime) is
+// addressed by a mask of the key mixed with its row number, instead of
+// the key modulo the row size.
+inline bool IsPowerOfTwoRow(uint32_t size)
+{
+	return size > 2 && (size & (size - 1)) == 0;
+}
+
+inline uint64_t MixRowKey(uint64_t rowKey, uint32_t row)
+{
+	rowKey += (uint64_t)(row + 1) * 0x9E3779B97F4A7C15ULL;
+	rowKey ^= rowKey >> 33;
+	rowKey *= 0xFF51AFD7ED558CCDULL;
+	rowKey ^= rowKey >> 33;
+	rowKey *= 0xC4CEB9FE1A85EC53ULL;
+	rowKey ^= rowKey >> 33;
+	return rowKey;
+}
+
+// n % d without a hardware division (Granlund-Montgomery / libdivide
+// branchfree scheme), valid for any 64-bit n and 2 <= d < 2^32.
+struct FastModulo
+{
+	uint64_t Multiplier;
+	uint32_t Divisor;
+	uint32_t Shift;
+
+	inline void Initialize(uint32_t divisor)
+	{
+		uint32_t log2 = 32 - __builtin_clz(divisor - 1);
+		Multiplier = (uint64_t)(((((__uint128_t)1) << (64 + log2)) / divisor) - (((__uint128_t)1) << 64) + 1);
+		Divisor = divisor;
+		Shift = log2 - 1;
+	}
+
+	inline uint64_t Mod(uint64_t num) const
+	{
+		uint64_t hi = (uint64_t)(((__uint128_t)Multiplier * num) >> 64);
+		uint64_t quotient = (hi + ((num - hi) >> 1)) >> Shift;
+		return num - quotient * Divisor;
+	}
+};
+
+template<uint32_t Prime, typename NextT>
+struct StaticSeed
+{
+	enum { Value = Prime };
+	typedef NextT NextType;
+};
+
+#define STATICSEED_1(P1) 										StaticSeed<P1, NullType>
+#define STATICSEED_2(P1, P2) 									StaticSeed<P1, STATICSEED_1(P2) >
+#define STATICSEED_3(P1, P2, P3) 								StaticSeed<P1, STATICSEED_2(P2, P3) >
+#define STATICSEED_4(P1, P2, P3, P4) 							StaticSeed<P1, STATICSEED_3(P2, P3, P4) >
+#define STATICSEED_5(P1, P2, P3, P4, P5) 						StaticSeed<P1, STATICSEED_4(P2, P3, P4, P5) >
+#define STATICSEED_6(P1, P2, P3, P4, P5, P6) 					StaticSeed<P1, STATICSEED_5(P2, P3, P4, P5, P6) >
+#define STATICSEED_7(P1, P2, P3, P4, P5, P6, P7) 				StaticSeed<P1, STATICSEED_6(P2, P3, P4, P5, P6, P7) >
+#define STATICSEED_8(P1, P2, P3, P4, P5, P6, P7, P8) 			StaticSeed<P1, STATICSEED_7(P2, P3, P4, P5, P6, P7, P8) >
+#define STATICSEED_9(P1, P2, P3, P4, P5, P6, P7, P8, P9) 		StaticSeed<P1, STATICSEED_8(P2, P3, P4, P5, P6, P7, P8, P9) >
+#define STATICSEED_10(P1, P2, P3, P4, P5, P6, P7, P8, P9, P10) 	StaticSeed<P1, STATICSEED_9(P2, P3, P4, P5, P6, P7, P8, P9, P10) >
+
+template<typename StaticSeedT> struct StaticSeedTraits;
+template<>
+struct StaticSeedTraits<NullType>
+{
+	enum { Size = 0 };
+
+	static inline void Fill(uint32_t* buffer)
+	{
+	}
+};
+template<uint32_t Prime, typename NextT>
+struct StaticSeedTraits< StaticSeed<Prime, NextT> >
+{
+	enum { Size = 1 + StaticSeedTraits<NextT>::Size };
+
+	static inline void Fill(uint32_t* buffer)
+	{
+		buffer[0] = Prime;
+		StaticSeedTraits<NextT>::Fill(buffer + 1);
+	}
+};
+
+// SEED_PRIME rows are the count primes below seed, SEED_POWEROFTWO rows
+// are count rows of the largest power of two not above seed
+enum SeedScheme
+{
+	SEED_PRIME = 0,
+	SEED_POWEROFTWO = 1
+};
+
 class Seed
 {
 public:
@@ -147,7 +296,8 @@ public:
 		return m_BufferSize;
 	}
 
-	Seed(uint32_t seed, uint32_t count);
+	Seed(uint32_t seed, uint32_t count, SeedScheme scheme = SEED_PRIME);
+	Seed(const uint32_t* buffer, uint32_t size);
 
 private:
 	uint32_t* m_Buffer;
@@ -23,7 +23,8 @@
 HashTableIterator::HashTableIterator() :
 	Offset(0),
 	Seed(0),
-	BufferIndex(0)
+	BufferIndex(0),
+	End((size_t)-1)
 {
 }
 
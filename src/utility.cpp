@@ -207,22 +207,78 @@ void HexDump(const char* ptr, size_t len, char** out)
 	}
 }
 
-uint32_t GetPrime(uint32_t num)
+// odd primes a candidate is divided by before the Miller-Rabin rounds
+static const uint32_t g_SmallPrimes[] = {
+	3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97
+};
+
+static inline uint32_t PowMod(uint64_t base, uint32_t exp, uint32_t mod)
 {
-	for(uint32_t prime=num; prime>=2; --prime)
+	uint64_t result = 1;
+	base %= mod;
+	for(; exp; exp >>= 1)
+	{
+		if(exp & 1)
+			result = result * base % mod;
+		base = base * base % mod;
+	}
+	return result;
+}
+
+// deterministic Miller-Rabin, the bases 2, 7 and 61 are enough below 2^32
+bool IsPrime(uint32_t num)
+{
+	if(num < 2)
+		return false;
+	if(num % 2 == 0)
+		return num == 2;
+
+	for(size_t i=0; i<sizeof(g_SmallPrimes)/sizeof(uint32_t); ++i)
+	{
+		if(num % g_SmallPrimes[i] == 0)
+			return num == g_SmallPrimes[i];
+	}
+	if(num < 97 * 97)
+		return true;
+
+	uint32_t d = num - 1;
+	uint32_t r = 0;
+	for(; d % 2 == 0; d >>= 1)
+		++r;
+
+	static const uint32_t bases[] = { 2, 7, 61 };
+	for(size_t i=0; i<sizeof(bases)/sizeof(uint32_t); ++i)
 	{
-		uint32_t mod = 1;
-		uint32_t prime_sqrt = (size_t)sqrt(prime);
-		for(uint32_t i=2; i<=prime_sqrt; ++i)
+		uint64_t x = PowMod(bases[i], d, num);
+		if(x == 1 || x == num - 1)
+			continue;
+
+		uint32_t j = 1;
+		for(; j<r; ++j)
 		{
-			mod = prime % i;
-			if(!mod)
+			x = x * x % num;
+			if(x == num - 1)
 				break;
 		}
-		if(mod)
+		if(j == r)
+			return false;
+	}
+	return true;
+}
+
+uint32_t GetPrime(uint32_t num)
+{
+	if(num < 2)
+		return 0;
+	if(num == 2)
+		return 2;
+
+	for(uint32_t prime=(num % 2)?num:num-1; prime>=3; prime-=2)
+	{
+		if(IsPrime(prime))
 			return prime;
 	}
-	return 0;
+	return 2;
 }
 
 uint32_t GetPrimes(uint32_t num, uint32_t* buffer, uint32_t len)
@@ -238,13 +294,42 @@ uint32_t GetPrimes(uint32_t num, uint32_t* buffer, uint32_t len)
 	return i;
 }
 
-Seed::Seed(uint32_t seed, uint32_t count) :
+uint32_t GetPowerOfTwo(uint32_t num)
+{
+	if(num == 0)
+		return 0;
+	return 1U << (31 - __builtin_clz(num));
+}
+
+Seed::Seed(uint32_t seed, uint32_t count, SeedScheme scheme) :
 	m_Buffer(NULL),
 	m_BufferSize(0)
 {
 	m_Buffer = (uint32_t*)malloc(sizeof(uint32_t)*count);
 	memset(m_Buffer, 0, sizeof(uint32_t)*count);
-	m_BufferSize = GetPrimes(seed, m_Buffer, count);
+
+	if(scheme == SEED_POWEROFTWO)
+	{
+		// same size for every row, the rows differ by their mixing salt
+		uint32_t size = GetPowerOfTwo(seed);
+		if(size > 2)
+		{
+			for(uint32_t i=0; i<count; ++i)
+				m_Buffer[i] = size;
+			m_BufferSize = count;
+		}
+	}
+	else
+		m_BufferSize = GetPrimes(seed, m_Buffer, count);
+}
+
+Seed::Seed(const uint32_t* buffer, uint32_t size) :
+	m_Buffer(NULL),
+	m_BufferSize(0)
+{
+	m_Buffer = (uint32_t*)malloc(sizeof(uint32_t)*size);
+	memcpy(m_Buffer, buffer, sizeof(uint32_t)*size);
+	m_BufferSize = size;
 }
 
 void Seed::Release()